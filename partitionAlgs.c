@@ -26,8 +26,28 @@
  #include <stdio.h>
  #include <stdlib.h>   // for malloc, free
  #include <time.h>     // for time
+ #include <unistd.h>   // for sysconf
+ #include <emmintrin.h>  // for _mm_stream_si32, _mm_stream_si128
+ #include <limits.h>   // for INT_MIN, INT_MAX
+ #include <pthread.h>  // for threads used by parallel selection
+ #include "verify.h"   // SIMD and threaded checks, multiset fingerprints
+ #include "selection.h"  // three-way quickselect, shared with the sort service
+ #include "partitionFamily.h"  // macros that generate the partition kernels
  
  #define printCopyTime 0  // 1 =  print times to copy arrays; 0 = omit this output
+ #define prefetchDistance 256      // elements ahead of each scan that are prefetched
+ #define lineInts 16               // ints in a 64-byte cache line, one prefetch each
+ #define blockBytes (256 * 1024)   // blocked partition works on blocks this large,
+                                   // chosen to stay well inside L2
+ #define cacheSweepMax (1 << 25)   // largest array in the cache level sweep
+ #define useStreamingStores 1      // 1 = out-of-place partition copies back with
+                                   // non-temporal stores; 0 = ordinary stores
+ #define selectOversample 16       // parallel selection samples 16 sqrt(n) elements
+ #define selectSpread 3            // pivots bracket rank k by 3 sqrt(samples) samples
+ #define selectMinSize 65536       // smaller arrays are selected serially
+ #define selectSweepMax (1 << 25)  // largest array in the parallel selection sweep
+ #define familySize (1 << 20)      // array partitioned by every generated kernel
+ #define familyElements (1 << 24)  // elements each kernel partitions per data set
  
  /** *******************************************************************************
   * structure to identify both the name of a partition algorithm and               *
@@ -38,6 +58,7 @@
  typedef struct algs {
    char * name;
  int (*proc) (int [ ], int, int, int);
+   int pivotAtRight;   // 1 = pivot taken from a[right]; 0 = from a[left]
  } partitionType;
  
  /** *******************************************************************************
@@ -60,20 +81,30 @@
    if( a[pivotSpot] != correctPivot) {
      return "NO1";
    }
-   int i;
-   for (i = first; i < pivotSpot; i++) {
-     if (a[i] > a[pivotSpot])
+   switch (verifyPartition (a, first, last, pivotSpot, verifyThreads)) {
+     case 2:
        return "NO2";
-   }
-   for (i = pivotSpot+1; i <= last; i++) {
-     if (a[i] < a[pivotSpot])
+     case 3:
        return "NO3";
    }
-  //  printf("\npicotSpot: %d\n", pivotSpot);
-  // printf("a[pivotSpot]: %d\n", a[pivotSpot]);
-  // printf("Correct picot: %d\n", correctPivot);
    return "OK!";
  }
+
+ /** *******************************************************************************
+  * checkPivotSpot, and also check the segment still holds the values it started  *
+  * with                                                                           *
+  * @param  before  fingerprintArray of a[first], ..., a[last] before partitioning *
+  * @post returns NO4 if the values of the segment changed, otherwise as           *
+  *              checkPivotSpot                                                    *
+  *********************************************************************************/
+ char * checkPivotPermutation (int pivotSpot, int correctPivot, int a [ ], int first, int last,
+                               fingerprintType before) {
+   char * result = checkPivotSpot (pivotSpot, correctPivot, a, first, last);
+   if (result[0] == 'O'
+       && !fingerprintEqual (fingerprintArray (a + first, last - first + 1, verifyThreads), before))
+     return "NO4";
+   return result;
+ }
  
  /** *******************************************************************************
   * procedure implements the partition operation, following Loop Invariant 1a      *
@@ -250,6 +281,262 @@
   return right + 1;
 }
 
+/** *******************************************************************************
+  * procedure implements the partition operation, following Loop Invariant 1a,    *
+  *    with software prefetching for arrays larger than the caches                 *
+  *    in brief: as invariant1a, but each scan asks for the cache line             *
+  *              prefetchDistance elements ahead of it, so both streams arrive     *
+  *              before they are compared instead of waiting on memory; a scan    *
+  *              prefetches only on reaching a new line, every lineInts elements   *
+  * @param   a      the array containing the segment to be partitioned             *
+  * @param   size   the size of array a                                            *
+  * @param   left   the index of the first array element in the partition          *
+  * @param   right  the index of the last array element in the partitionn          *
+  * @post    a[left] is moved to index mid, with left <= mid <= right              *
+  * @post    elements between left and right are permuted, so that                 *
+  *             a[left], ..., a[mid-1] <= a[mid]                                   *
+  *             a[mid+1], ..., a[right] >= a[mid]                                  *
+  * @post    elements outside left, ..., right are not changed                     *
+  * @returns  mid                                                                  *
+  *********************************************************************************/
+ int prefetchPartition (int a[ ], int size, int left, int right) {
+   int pivot = a[left];
+   int l_spot = left+1;
+   int r_spot = right;
+   int l_fetch = l_spot + prefetchDistance;   // next element each scan prefetches
+   int r_fetch = r_spot - prefetchDistance;
+   int temp;
+
+   while (l_spot <= r_spot) {
+     while( (l_spot <= r_spot) && (a[r_spot] >= pivot)) {
+       if (r_spot - prefetchDistance <= r_fetch && r_fetch >= left) {
+         __builtin_prefetch (&a[r_fetch], 1);
+         r_fetch -= lineInts;
+       }
+       r_spot--;
+     }
+     while ((l_spot <= r_spot) && (a[l_spot] <= pivot)) {
+       if (l_spot + prefetchDistance >= l_fetch && l_fetch <= right) {
+         __builtin_prefetch (&a[l_fetch], 1);
+         l_fetch += lineInts;
+       }
+       l_spot++;
+     }
+
+     // if misplaced small and large values found, swap them
+     if (l_spot < r_spot) {
+       temp = a[l_spot];
+       a[l_spot] = a[r_spot];
+       a[r_spot] = temp;
+       l_spot++;
+       r_spot--;
+       }
+   }
+
+   // swap a[left] with biggest small value
+   temp = a[left];
+   a[left] = a[r_spot];
+   a[r_spot] = temp;
+   return r_spot;
+ }
+
+/** *******************************************************************************
+  * split one block around a given pivot value, as in Loop Invariant 1a            *
+  * @param   a      the array containing the block                                 *
+  * @param   lo     the index of the first element of the block                    *
+  * @param   hi     the index of the last element of the block                     *
+  * @param   pivot  the value to split around                                      *
+  * @post    a[lo], ..., a[split-1] <= pivot and a[split], ..., a[hi] >= pivot     *
+  * @returns split                                                                 *
+  *********************************************************************************/
+ int blockSplit (int a[ ], int lo, int hi, int pivot) {
+   int l_spot = lo;
+   int r_spot = hi;
+   int temp;
+
+   while (l_spot <= r_spot) {
+     while( (l_spot <= r_spot) && (a[r_spot] >= pivot))
+       r_spot--;
+     while ((l_spot <= r_spot) && (a[l_spot] <= pivot))
+       l_spot++;
+     if (l_spot < r_spot) {
+       temp = a[l_spot];
+       a[l_spot] = a[r_spot];
+       a[r_spot] = temp;
+       l_spot++;
+       r_spot--;
+       }
+   }
+   return l_spot;
+ }
+
+/** *******************************************************************************
+  * procedure implements the partition operation with a blocked layout that keeps  *
+  *    the working set in L2                                                       *
+  *    in brief: a[left+1], ..., a[right] is cut into blocks of blockBytes, each   *
+  *              block is split around a[left] while it sits in L2, then the large *
+  *              values left of the final split are swapped with the small values  *
+  *              right of it; both of those swap streams move forward through      *
+  *              memory, so no pass reads the array from both ends at once         *
+  * @param   a      the array containing the segment to be partitioned             *
+  * @param   size   the size of array a                                            *
+  * @param   left   the index of the first array element in the partition          *
+  * @param   right  the index of the last array element in the partitionn          *
+  * @post    a[left] is moved to index mid, with left <= mid <= right              *
+  * @post    elements between left and right are permuted, so that                 *
+  *             a[left], ..., a[mid-1] <= a[mid]                                   *
+  *             a[mid+1], ..., a[right] >= a[mid]                                  *
+  * @post    elements outside left, ..., right are not changed                     *
+  * @returns  mid                                                                  *
+  *********************************************************************************/
+ int blockedPartition (int a[ ], int size, int left, int right) {
+   int pivot = a[left];
+   int block = blockBytes / sizeof(int);
+   int first = left + 1;
+   int blocks = (right - first + block) / block;
+   int * split = (int *) malloc ((blocks + 1) * sizeof(int));
+   int temp;
+
+   // split each block on its own, counting the small values
+   int smallEnd = first;
+   for (int b = 0; b < blocks; b++) {
+     int lo = first + b * block;
+     int hi = (lo + block - 1 < right) ? lo + block - 1 : right;
+     split[b] = blockSplit (a, lo, hi, pivot);
+     smallEnd += split[b] - lo;
+   }
+
+   // large values before smallEnd trade places with small values from smallEnd on
+   int lb = 0;
+   int li = (blocks > 0) ? split[0] : first;
+   int lbLast = (first + block - 1 < right) ? first + block - 1 : right;
+   int rb = (smallEnd - first) / block;
+   int ri = smallEnd;
+   while (lb < blocks) {
+     if (li > lbLast) {
+       lb++;
+       if (lb < blocks) {
+         li = split[lb];
+         lbLast = (lbLast + block < right) ? lbLast + block : right;
+       }
+       continue;
+     }
+     if (li >= smallEnd)
+       break;
+     while (rb < blocks && ri >= split[rb]) {
+       rb++;
+       ri = first + rb * block;
+     }
+     temp = a[li];
+     a[li] = a[ri];
+     a[ri] = temp;
+     li++;
+     ri++;
+   }
+   free (split);
+
+   // swap a[left] with biggest small value
+   temp = a[left];
+   a[left] = a[smallEnd - 1];
+   a[smallEnd - 1] = temp;
+   return smallEnd - 1;
+ }
+
+/** *******************************************************************************
+  * copy an array segment with non-temporal stores, which bypass the caches, so    *
+  *    writing a large segment does not evict data that will be read again         *
+  * @param   dst    the destination segment                                        *
+  * @param   src    the source segment                                             *
+  * @param   n      the number of elements to copy                                 *
+  * @post    dst[0], ..., dst[n-1] equal src[0], ..., src[n-1]                     *
+  *********************************************************************************/
+ void streamCopy (int dst[ ], int src[ ], int n) {
+   int i = 0;
+ #if useStreamingStores
+   // single stores until dst reaches a 16 byte boundary, then 4 at a time
+   for (; i < n && ((unsigned long) &dst[i] & 15) != 0; i++)
+     _mm_stream_si32 (&dst[i], src[i]);
+   for (; i + 4 <= n; i += 4)
+     _mm_stream_si128 ((__m128i *) &dst[i], _mm_loadu_si128 ((__m128i *) &src[i]));
+   for (; i < n; i++)
+     _mm_stream_si32 (&dst[i], src[i]);
+   _mm_sfence ();
+ #else
+   for (; i < n; i++)
+     dst[i] = src[i];
+ #endif
+ }
+
+/** *******************************************************************************
+  * procedure implements the partition operation out of place, in the style of    *
+  *    ska_sort and IPS4o                                                          *
+  *    in brief: elements after the pivot are read once, front to back; each is    *
+  *              written both at the next small slot from the front of scratch and *
+  *              the next large slot from the back, and only one of the two        *
+  *              cursors moves, so the loop has no data-dependent branch; scratch  *
+  *              is then copied back with streamCopy                               *
+  * @param   a       the array containing the segment to be partitioned            *
+  * @param   scratch scratch space for at least right-left+1 elements, supplied    *
+  *                  by the caller                                                 *
+  * @param   size    the size of array a                                           *
+  * @param   left    the index of the first array element in the partition         *
+  * @param   right   the index of the last array element in the partitionn         *
+  * @post    a[left] is moved to index mid, with left <= mid <= right              *
+  * @post    elements between left and right are permuted, so that                 *
+  *             a[left], ..., a[mid-1] <= a[mid]                                   *
+  *             a[mid+1], ..., a[right] >= a[mid]                                  *
+  * @post    elements outside left, ..., right are not changed                     *
+  * @returns  mid                                                                  *
+  *********************************************************************************/
+ int outOfPlacePartition (int a[ ], int scratch[ ], int size, int left, int right) {
+   int pivot = a[left];
+   int lo = 0;
+   int hi = right - left;
+   int v, small;
+
+   for (int i = left + 1; i <= right; i++) {
+     v = a[i];
+     scratch[lo] = v;
+     scratch[hi] = v;
+     small = (v < pivot) | ((v == pivot) & i);   // ties alternate sides
+     lo += small;
+     hi -= 1 - small;
+   }
+   scratch[lo] = pivot;
+
+   streamCopy (&a[left], scratch, right - left + 1);
+   return left + lo;
+ }
+
+ /* scratch buffer handed to outOfPlacePartition when it is timed through
+    partitionType, whose procedures take no scratch argument; set by main */
+ int * partitionScratch = NULL;
+
+ int outOfPlaceScratch (int a[ ], int size, int left, int right) {
+   return outOfPlacePartition (a, partitionScratch, size, left, right);
+ }
+
+ /* * * * * * * * * * generated family of partition kernels * * * * * * * * * * */
+
+ forEachPartition (definePartition)
+
+ /** *******************************************************************************
+  * structure to identify a generated kernel, for the family benchmark             *
+  *********************************************************************************/
+ typedef struct generated {
+   char * name;
+   int (*proc) (int [ ], int, int, int);
+   int pivotAtRight;   // 1 = pivot position Right
+   int pivotFirst;     // 1 = pivot choice First, so the pivot is known beforehand
+ } generatedType;
+
+ #define generatedEntry(pos, scan, swap, choice)                                \
+   {#pos " " #scan " " #swap " " #choice, partition##pos##scan##swap##choice,  \
+    isRight##pos, isFirst##choice},
+
+ generatedType generatedArray [ ] = { forEachPartition (generatedEntry) };
+ #define numGenerated ((int) (sizeof(generatedArray) / sizeof(generatedType)))
+
 /** *******************************************************************************
   * procedure implements the kth element operation,      *
   *    in brief: array segment is partitioned until it finds the kth smallest element at the pivot  *
@@ -296,17 +583,201 @@ int kthElementHelper (int a[], const int size, const int k, int l_index, int r_i
   return kthElementHelper(a, size, k, l_index, middle - 1, middle);
 }
 
+/** *******************************************************************************
+  * wall clock time, used to time parallel selection, since clock() adds together  *
+  * the processor time of every thread                                             *
+  * @returns  seconds since an arbitrary fixed starting point                      *
+  *********************************************************************************/
+ double wallClock ( ) {
+   struct timespec now;
+   clock_gettime (CLOCK_MONOTONIC, &now);
+   return now.tv_sec + now.tv_nsec / 1e9;
+ }
+
+/** *******************************************************************************
+  * integer square root                                                            *
+  * @returns  the largest r with r*r <= n                                          *
+  *********************************************************************************/
+ long isqrt (long n) {
+   long r = 0;
+   long bit = 1L << 62;
+   while (bit > n)
+     bit >>= 2;
+   while (bit != 0) {
+     if (n >= r + bit) {
+       n -= r + bit;
+       r = (r >> 1) + bit;
+     }
+     else
+       r >>= 1;
+     bit >>= 2;
+   }
+   return r;
+ }
+
+ int compareInts (const void * x, const void * y) {
+   int a = *(const int *) x;
+   int b = *(const int *) y;
+   return (a > b) - (a < b);
+ }
+
+/** *******************************************************************************
+  * structure describing the share of one thread in parallel selection             *
+  *********************************************************************************/
+ typedef struct selectArgs {
+   int * a;             // the array being searched
+   long first;          // this thread handles a[first], ..., a[last-1]
+   long last;
+   int * sample;        // where this thread puts its samples
+   int samples;         // the number of samples this thread draws
+   unsigned seed;       // for rand_r, since rand is shared by all threads
+   int low;             // the pivots bracketing rank k
+   int high;
+   long less;           // elements of the share below low
+   long between;        // elements of the share from low to high
+   int * candidates;    // where this thread puts its elements from low to high
+ } selectType;
+
+ void * selectSampleThread (void * arg) {
+   selectType * t = (selectType *) arg;
+   for (int i = 0; i < t->samples; i++)
+     t->sample[i] = t->a[t->first + rand_r (&t->seed) % (t->last - t->first)];
+   return NULL;
+ }
+
+ void * selectCountThread (void * arg) {
+   selectType * t = (selectType *) arg;
+   long less = 0;
+   long between = 0;
+   for (long i = t->first; i < t->last; i++) {
+     int x = t->a[i];
+     less += (x < t->low);
+     between += (x >= t->low) & (x <= t->high);
+   }
+   t->less = less;
+   t->between = between;
+   return NULL;
+ }
+
+ void * selectCompactThread (void * arg) {
+   selectType * t = (selectType *) arg;
+   long o = 0;
+   for (long i = t->first; i < t->last; i++) {
+     int x = t->a[i];
+     if (x >= t->low && x <= t->high)
+       t->candidates[o++] = x;
+   }
+   return NULL;
+ }
+
+/** *******************************************************************************
+  * run one phase of parallel selection on every thread and wait for all of them   *
+  *********************************************************************************/
+ void selectPhase (void * (*phase) (void *), selectType args [ ], int threads) {
+   pthread_t thread [threads];
+   for (int t = 1; t < threads; t++)
+     pthread_create (&thread[t], NULL, phase, &args[t]);
+   phase (&args[0]);
+   for (int t = 1; t < threads; t++)
+     pthread_join (thread[t], NULL);
+ }
+
+/** *******************************************************************************
+  * serial fallback of parallel selection, on a copy so a is not changed           *
+  *********************************************************************************/
+ int selectCopy (int a[ ], const int size, const int k) {
+   int * copy = (int *) malloc (size * sizeof(int));
+   for (int i = 0; i < size; i++)
+     copy[i] = a[i];
+   int result = threeWaySelect (copy, size, k);
+   free (copy);
+   return result;
+ }
+
+/** *******************************************************************************
+  * procedure implements the kth element operation with several threads           *
+  *    in brief: the threads sample the array, and two sampled values just below   *
+  *              and above rank k become pivots; the threads count the elements    *
+  *              below and between the pivots, then copy the ones between into a   *
+  *              small candidate buffer, where threeWaySelect finishes serially    *
+  * @param   a        the array to be searched                                     *
+  * @param   size     the size of array a                                          *
+  * @param   k        the kth smallest element                                     *
+  * @param   threads  the number of threads                                        *
+  * @post    a is not changed                                                      *
+  * @returns value of kth smallest element, or -1 if k > size                      *
+  *********************************************************************************/
+ int parallelKthElement (int a[], const int size, const int k, int threads) {
+   if (k > size)
+     return -1;
+   if (size < selectMinSize)
+     return selectCopy (a, size, k);
+
+   selectType args [threads];
+   int samples = selectOversample * isqrt (size) / threads * threads;
+   int * sample = (int *) malloc (samples * sizeof(int));
+   for (int t = 0; t < threads; t++) {
+     args[t].a = a;
+     args[t].first = (long) size * t / threads;
+     args[t].last = (long) size * (t + 1) / threads;
+     args[t].sample = sample + samples / threads * t;
+     args[t].samples = samples / threads;
+     args[t].seed = rand ();
+   }
+   selectPhase (selectSampleThread, args, threads);
+   qsort (sample, samples, sizeof(int), compareInts);
+
+   // sample rank of k, widened by selectSpread standard deviations
+   long r = (long) k * samples / size;
+   long spread = selectSpread * isqrt (samples);
+   int low = (r - spread < 0) ? INT_MIN : sample[r - spread];
+   int high = (r + spread >= samples) ? INT_MAX : sample[r + spread];
+   free (sample);
+
+   long less = 0;
+   long between = 0;
+   for (int t = 0; t < threads; t++) {
+     args[t].low = low;
+     args[t].high = high;
+   }
+   selectPhase (selectCountThread, args, threads);
+   for (int t = 0; t < threads; t++) {
+     less += args[t].less;
+     between += args[t].between;
+   }
+
+   // the pivots missed rank k, which the spread makes very unlikely
+   if (k <= less || k > less + between)
+     return selectCopy (a, size, k);
+   if (low == high)
+     return low;
+
+   // each thread writes just past the candidates of the threads before it
+   int * candidates = (int *) malloc (between * sizeof(int));
+   long offset = 0;
+   for (int t = 0; t < threads; t++) {
+     args[t].candidates = candidates + offset;
+     offset += args[t].between;
+   }
+   selectPhase (selectCompactThread, args, threads);
+
+   int result = threeWaySelect (candidates, between, k - less);
+   free (candidates);
+   return result;
+ }
+
  /** *******************************************************************************
   * driver program for testing and timing partition algorithms                     *
   *********************************************************************************/
  
  int main ( ) {
    // identify partition procedures used and their decriptive names
-   #define numAlgs  4
-   partitionType procArray [numAlgs] = {{"invariant 1a ", invariant1a   },
-                                        {"invariant 1b ", invariant1b   },
-                                        {"invariant 5  ", invariant5 },
-                                        {"invariant 7  ", invariant7 }};
+   #define numAlgs  5
+   partitionType procArray [numAlgs] = {{"invariant 1a ", invariant1a, 0 },
+                                        {"invariant 1b ", invariant1b, 0 },
+                                        {"invariant 5  ", invariant5,  1 },
+                                        {"invariant 7  ", invariant7,  1 },
+                                        {"out-of-place ", outOfPlaceScratch, 0 }};
  
    // print output headers
    printf ("timing/testing of partition functions\n");
@@ -331,11 +802,14 @@ int kthElementHelper (int a[], const int size, const int k, int l_index, int r_i
          ran[i] = rand();
          des[i] = 2*(size - i - 1); 
       }
+      // fingerprint of the random data, to catch a partition that loses values
+      fingerprintType ranPrint = fingerprintArray (ran, size, verifyThreads);
       
       // copy to test arrays
       int * tempAsc = malloc (size * sizeof(int));
       int * tempRan = malloc (size * sizeof(int));
       int * tempDes = malloc (size * sizeof(int));
+      partitionScratch = (int *) malloc (size * sizeof(int));
  
       // repeat for each algorithm
       for (int alg = 0; alg < numAlgs; alg++) {
@@ -379,7 +853,7 @@ int kthElementHelper (int a[], const int size, const int k, int l_index, int r_i
         elapsed_time = (end_time - start_time) / (double) CLOCKS_PER_SEC;
         printf ("%13.1lf ", elapsed_time - copy_time);
 
-        if (alg >= 2){
+        if (procArray[alg].pivotAtRight){
           printf ("%3s  ", checkPivotSpot (pivotSpot, (size - 1)* 2, tempAsc, 0, size-1));
         }
         else{
@@ -412,11 +886,11 @@ int kthElementHelper (int a[], const int size, const int k, int l_index, int r_i
         end_time = clock();
         elapsed_time = (end_time - start_time) / (double) CLOCKS_PER_SEC;
         printf ("%13.1lf ", elapsed_time - copy_time);
-        if (alg >= 2){
-          printf ("%3s ", checkPivotSpot (pivotSpot, ran[size - 1], tempRan, 0, size-1));
+        if (procArray[alg].pivotAtRight){
+          printf ("%3s ", checkPivotPermutation (pivotSpot, ran[size - 1], tempRan, 0, size-1, ranPrint));
         }
         else{
-          printf ("%3s ", checkPivotSpot (pivotSpot, ran[0], tempRan, 0, size-1));
+          printf ("%3s ", checkPivotPermutation (pivotSpot, ran[0], tempRan, 0, size-1, ranPrint));
         }
       
         /* * * * * * * test descending data * * * * * * */
@@ -448,7 +922,7 @@ int kthElementHelper (int a[], const int size, const int k, int l_index, int r_i
         end_time = clock();
         elapsed_time = (end_time - start_time) / (double) CLOCKS_PER_SEC;
         printf ("%13.1lf ", elapsed_time - copy_time);
-        if (alg >= 2){
+        if (procArray[alg].pivotAtRight){
           printf ("%3s ", checkPivotSpot (pivotSpot, 0, tempDes, 0, size-1));
         }
         else{
@@ -474,6 +948,7 @@ int kthElementHelper (int a[], const int size, const int k, int l_index, int r_i
       free (tempAsc);
       free (tempRan);
       free (tempDes);
+      free (partitionScratch);
            
       // clean up original test arrays
       free (asc);
@@ -481,6 +956,182 @@ int kthElementHelper (int a[], const int size, const int k, int l_index, int r_i
       free (des);
       
    } // end of loop for testing procedures with different array sizes
+
+   /* * * * * * * * cache level sweep of the cache-aware partitions * * * * * * * */
+   #define numCacheAlgs 4
+   partitionType cacheArray [numCacheAlgs] = {{"invariant 1a ", invariant1a,       0 },
+                                              {"prefetch     ", prefetchPartition, 0 },
+                                              {"blocked      ", blockedPartition,  0 },
+                                              {"out-of-place ", outOfPlaceScratch, 0 }};
+   long l1 = sysconf (_SC_LEVEL1_DCACHE_SIZE);
+   long l2 = sysconf (_SC_LEVEL2_CACHE_SIZE);
+   long l3 = sysconf (_SC_LEVEL3_CACHE_SIZE);
+
+   printf ("nanoseconds per element, random data, as the array outgrows each cache level\n");
+   printf ("    Size  Level ");
+   for (int alg = 0; alg < numCacheAlgs; alg++)
+     printf ("  %s", cacheArray[alg].name);
+   printf ("\n");
+
+   for (size = 1 << 12; size <= cacheSweepMax; size *= 2) {
+      long bytes = size * sizeof(int);
+      char * level = (bytes <= l1) ? "L1" : (bytes <= l2) ? "L2" : (bytes <= l3) ? "L3" : "DRAM";
+      int * ran = (int *) malloc (size * sizeof(int));
+      int * tempRan = (int *) malloc (size * sizeof(int));
+      partitionScratch = (int *) malloc (size * sizeof(int));
+      int i;
+      for (i = 0; i< size; i++)
+         ran[i] = rand();
+      // enough repetitions that every size processes about the same total
+      int sweepReps = (1 << 26) / size;
+      if (sweepReps < 1)
+        sweepReps = 1;
+
+      printf ("%8d  %-5s", size, level);
+      for (int alg = 0; alg < numCacheAlgs; alg++) {
+        clock_t start_time, end_time;
+        double copy_time, elapsed_time;
+        int pivotSpot;
+
+        start_time = clock ();
+        for (reps = 0; reps < sweepReps; reps++) {
+          for (i = 0; i< size; i++) {
+            tempRan[i] = ran[i];
+          }
+        }
+        end_time = clock();
+        copy_time = ((end_time - start_time) / (double) CLOCKS_PER_SEC );
+
+        start_time = clock ();
+        for (reps = 0; reps < sweepReps; reps++) {
+          for (i = 0; i< size; i++) {
+            tempRan[i] = ran[i];
+          }
+          pivotSpot = cacheArray[alg].proc (tempRan, size, 0, size-1);
+        }
+        end_time = clock();
+        elapsed_time = (end_time - start_time) / (double) CLOCKS_PER_SEC;
+        printf ("%11.2lf %3s", (elapsed_time - copy_time) * 1e9 / ((double) size * sweepReps),
+                checkPivotSpot (pivotSpot, ran[0], tempRan, 0, size-1));
+      }
+      printf ("\n");
+
+      free (ran);
+      free (tempRan);
+      free (partitionScratch);
+   }
+ 
+   /* * * * * * * * * * * parallel selection sweep * * * * * * * * * * * * * * */
+   printf ("\nparallel selection of the median and 99th percentile, random data, seconds\n");
+   printf ("    Size  Rank     kthElement  1 thread 2 threads 4 threads 8 threads\n");
+   for (size = 1 << 20; size <= selectSweepMax; size *= 2) {
+      int * ran = (int *) malloc (size * sizeof(int));
+      int * tempRan = (int *) malloc (size * sizeof(int));
+      int i;
+      for (i = 0; i< size; i++)
+         ran[i] = rand();
+
+      int ranks [2] = {size / 2, (int) ((long) size * 99 / 100)};
+      for (int q = 0; q < 2; q++) {
+        int k = ranks[q];
+        double start_wall, elapsed_time;
+        printf ("%8d  %-5s", size, (q == 0) ? "50%" : "99%");
+
+        // serial kthElement permutes its array, so it works on a copy
+        for (i = 0; i< size; i++)
+          tempRan[i] = ran[i];
+        start_wall = wallClock ();
+        int expected = kthElement (tempRan, size, k);
+        elapsed_time = wallClock () - start_wall;
+        printf ("%14.3lf", elapsed_time);
+
+        for (int threads = 1; threads <= 8; threads *= 2) {
+          start_wall = wallClock ();
+          int found = parallelKthElement (ran, size, k, threads);
+          elapsed_time = wallClock () - start_wall;
+          printf ("%7.3lf %2s", elapsed_time, (found == expected) ? "ok" : "NO");
+        }
+        printf ("\n");
+      }
+
+      free (ran);
+      free (tempRan);
+   }
+
+   /* * * * * * * * * generated partition family benchmark * * * * * * * * * * */
+   // every kernel of the cross-product on the same four data sets, with the copy
+   // time subtracted as above; the fastest kernel for each data set closes the table
+   size = familySize;
+   int familyReps = familyElements / size;
+   char * setNames [4] = {"Ascending", "Random", "16 Distinct", "Descending"};
+   int * sets [4];
+   for (int set = 0; set < 4; set++)
+      sets[set] = (int *) malloc (size * sizeof(int));
+   int * tempSet = (int *) malloc (size * sizeof(int));
+   for (int i = 0; i< size; i++) {
+      sets[0][i] = 2*i;
+      sets[1][i] = rand();
+      sets[2][i] = rand() % 16;
+      sets[3][i] = 2*(size - i - 1);
+   }
+   fingerprintType setPrints [4];
+   for (int set = 0; set < 4; set++)
+      setPrints[set] = fingerprintArray (sets[set], size, verifyThreads);
+   double bestTime [4];
+   int bestAlg [4];
+
+   printf ("\ngenerated partition family, %d elements, nanoseconds per element\n", size);
+   printf ("%-26s", "Kernel");
+   for (int set = 0; set < 4; set++)
+     printf ("%12s    ", setNames[set]);
+   printf ("\n");
+   for (int alg = 0; alg < numGenerated; alg++) {
+      printf ("%-26s", generatedArray[alg].name);
+      for (int set = 0; set < 4; set++) {
+        clock_t start_time, end_time;
+        double copy_time, elapsed_time;
+        int pivotSpot, i;
+
+        start_time = clock ();
+        for (reps = 0; reps < familyReps; reps++) {
+          for (i = 0; i< size; i++) {
+            tempSet[i] = sets[set][i];
+          }
+        }
+        end_time = clock();
+        copy_time = ((end_time - start_time) / (double) CLOCKS_PER_SEC );
+
+        start_time = clock ();
+        for (reps = 0; reps < familyReps; reps++) {
+          for (i = 0; i< size; i++) {
+            tempSet[i] = sets[set][i];
+          }
+          pivotSpot = generatedArray[alg].proc (tempSet, size, 0, size-1);
+        }
+        end_time = clock();
+        elapsed_time = (end_time - start_time) / (double) CLOCKS_PER_SEC;
+        elapsed_time = (elapsed_time - copy_time) * 1e9 / ((double) size * familyReps);
+        if (alg == 0 || elapsed_time < bestTime[set]) {
+          bestTime[set] = elapsed_time;
+          bestAlg[set] = alg;
+        }
+
+        // only a First kernel's pivot is known beforehand
+        int pivot = tempSet[pivotSpot];
+        if (generatedArray[alg].pivotFirst)
+          pivot = sets[set][generatedArray[alg].pivotAtRight ? size - 1 : 0];
+        printf ("%12.2lf %3s", elapsed_time,
+                checkPivotPermutation (pivotSpot, pivot, tempSet, 0, size-1, setPrints[set]));
+      }
+      printf ("\n");
+   }
+   for (int set = 0; set < 4; set++)
+     printf ("fastest on %-12s %-26s %6.2lf\n", setNames[set], generatedArray[bestAlg[set]].name,
+             bestTime[set]);
+
+   for (int set = 0; set < 4; set++)
+     free (sets[set]);
+   free (tempSet);
  
    return 0;
  }
\ No newline at end of file
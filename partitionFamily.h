@@ -0,0 +1,220 @@
+/* generated family of partition kernels, shared by the timing programs
+ *
+ *    quicksortComparisons.c builds basicPartition, imprPartition and
+ *    hybridPartition from these macros, and partitionAlgs.c builds and times
+ *    every combination, so the partitions the sorts use cannot drift apart
+ *    from the ones the partition benchmark measures
+ */
+
+ #ifndef partitionFamilyIncluded
+ #define partitionFamilyIncluded
+
+ #include <stdlib.h>   // for rand
+
+ /* the hand-written partitions in partitionAlgs.c differ only in four choices;
+    the macros below write one kernel for each combination at compile time, so
+    no kernel tests an option while it runs
+      pivot position  Left, Right    where the pivot waits while the rest is split
+      scan            Both           two indices converge, as in invariant 1a
+                      Up             one index walks up, and values that belong
+                                     above the pivot go to the top of the
+                                     unprocessed elements, as in invariants 1b, 5
+                      Down           one index walks down, the mirror image of Up
+      swap scheme     Temp           misplaced pairs exchanged through a temporary
+                      Hole           the pivot is lifted out and values move into
+                                     the hole it leaves, one store per move
+      pivot choice    First          the element already at the pivot position
+                      Random         a random element, as in imprPartition
+                      Median3        the median of the first, middle and last
+    so partitionLeftBothTempFirst is invariant1a and basicPartition,
+    partitionLeftUpTempFirst is invariant1b, partitionRightUpTempFirst is
+    invariant5 and partitionLeftBothTempRandom is imprPartition and
+    hybridPartition; invariant 7 exchanges with the boundary behind its index
+    rather than with the far end, and is nearest to partitionRightDownTempFirst
+
+    each kernel is written once with the pivot at the left; a kernel with the
+    pivot at the right runs the same code on the mirror image of the segment,
+    reading index i as left + right - i and reversing every comparison, so Up
+    on the mirror image walks down the array and the other way round */
+
+ #define atLeft(i) a[i]                          // element i of the segment as seen
+ #define atRight(i) a[left + right - (i)]        // from a left or a right pivot
+ #define lessLeft(x, y) ((x) < (y))
+ #define lessRight(x, y) ((y) < (x))
+ #define indexLeft(i) (i)
+ #define indexRight(i) (left + right - (i))
+ #define isRightLeft 0
+ #define isRightRight 1
+ #define isFirstFirst 1
+ #define isFirstRandom 0
+ #define isFirstMedian3 0
+
+ // which left-pivot scan runs on the mirror image, for each position and scan
+ #define scanOfLeftBoth bothScan
+ #define scanOfLeftUp upScan
+ #define scanOfLeftDown downScan
+ #define scanOfRightBoth bothScan
+ #define scanOfRightUp downScan
+ #define scanOfRightDown upScan
+ #define bothScan(swap, at, less) both##swap (at, less)
+ #define upScan(swap, at, less) up##swap (at, less)
+ #define downScan(swap, at, less) down##swap (at, less)
+
+ #define exchange(at, i, j) {                                                   \
+   temp = at (i);                                                               \
+   at (i) = at (j);                                                             \
+   at (j) = temp;                                                               \
+ }
+
+ // pivot choices: move the chosen element to at (left)
+ #define chooseFirst(at, less)
+ #define chooseRandom(at, less) {                                               \
+   int r = left + (rand() % (right - left + 1));                                \
+   exchange (at, r, left);                                                      \
+ }
+ #define chooseMedian3(at, less) {                                              \
+   int m = left + (right - left) / 2;                                           \
+   if (less (at (m), at (left)))                                                \
+     exchange (at, m, left);                                                    \
+   if (less (at (right), at (left)))                                            \
+     exchange (at, right, left);                                                \
+   if (less (at (right), at (m)))                                               \
+     exchange (at, right, m);                                                   \
+   exchange (at, m, left);                                                      \
+ }
+
+ // scans: partition around at (left), leaving its final index in mid
+ #define bothTemp(at, less) {                                                   \
+   int pivot = at (left);                                                       \
+   int l_spot = left + 1;                                                       \
+   int r_spot = right;                                                          \
+   while (l_spot <= r_spot) {                                                   \
+     while ((l_spot <= r_spot) && !less (at (r_spot), pivot))                   \
+       r_spot--;                                                                \
+     while ((l_spot <= r_spot) && !less (pivot, at (l_spot)))                   \
+       l_spot++;                                                                \
+     if (l_spot < r_spot) {                                                     \
+       exchange (at, l_spot, r_spot);                                           \
+       l_spot++;                                                                \
+       r_spot--;                                                                \
+     }                                                                          \
+   }                                                                            \
+   exchange (at, left, r_spot);                                                 \
+   mid = r_spot;                                                                \
+ }
+ #define bothHole(at, less) {                                                   \
+   int pivot = at (left);         /* hole at l_spot */                          \
+   int l_spot = left;                                                           \
+   int r_spot = right;                                                          \
+   while (l_spot < r_spot) {                                                    \
+     while ((l_spot < r_spot) && !less (at (r_spot), pivot))                    \
+       r_spot--;                                                                \
+     at (l_spot) = at (r_spot);   /* hole moves to r_spot */                    \
+     while ((l_spot < r_spot) && !less (pivot, at (l_spot)))                    \
+       l_spot++;                                                                \
+     at (r_spot) = at (l_spot);   /* and back to l_spot */                      \
+   }                                                                            \
+   at (l_spot) = pivot;                                                         \
+   mid = l_spot;                                                                \
+ }
+ #define upTemp(at, less) {                                                     \
+   int pivot = at (left);                                                       \
+   int l_spot = left + 1;                                                       \
+   int r_spot = right;                                                          \
+   while (l_spot <= r_spot) {                                                   \
+     if (less (at (l_spot), pivot))                                             \
+       l_spot++;                                                                \
+     else {                                                                     \
+       exchange (at, l_spot, r_spot);                                           \
+       r_spot--;                                                                \
+     }                                                                          \
+   }                                                                            \
+   exchange (at, left, r_spot);                                                 \
+   mid = r_spot;                                                                \
+ }
+ #define upHole(at, less) {                                                     \
+   int pivot = at (left);                                                       \
+   at (left) = at (right);        /* hole at r_spot, above the unprocessed */   \
+   int l_spot = left;                                                           \
+   int r_spot = right;                                                          \
+   while (l_spot < r_spot) {                                                    \
+     int v = at (l_spot);                                                       \
+     if (less (v, pivot))                                                       \
+       l_spot++;                                                                \
+     else {                                                                     \
+       at (r_spot) = v;                                                         \
+       at (l_spot) = at (r_spot - 1);                                           \
+       r_spot--;                                                                \
+     }                                                                          \
+   }                                                                            \
+   at (r_spot) = pivot;                                                         \
+   mid = r_spot;                                                                \
+ }
+ #define downTemp(at, less) {                                                   \
+   int pivot = at (left);                                                       \
+   int l_spot = left + 1;                                                       \
+   int r_spot = right;                                                          \
+   while (l_spot <= r_spot) {                                                   \
+     if (less (pivot, at (r_spot)))                                             \
+       r_spot--;                                                                \
+     else {                                                                     \
+       exchange (at, l_spot, r_spot);                                           \
+       l_spot++;                                                                \
+     }                                                                          \
+   }                                                                            \
+   exchange (at, left, r_spot);                                                 \
+   mid = r_spot;                                                                \
+ }
+ #define downHole(at, less) {                                                   \
+   int pivot = at (left);         /* hole at l_spot, below the unprocessed */   \
+   int l_spot = left;                                                           \
+   int r_spot = right;                                                          \
+   while (l_spot < r_spot) {                                                    \
+     int v = at (r_spot);                                                       \
+     if (less (pivot, v))                                                       \
+       r_spot--;                                                                \
+     else {                                                                     \
+       at (l_spot) = v;                                                         \
+       at (r_spot) = at (l_spot + 1);                                           \
+       l_spot++;                                                                \
+     }                                                                          \
+   }                                                                            \
+   at (l_spot) = pivot;                                                         \
+   mid = l_spot;                                                                \
+ }
+
+ /** *******************************************************************************
+  * generator: a partition kernel named name, for a position, scan, swap scheme   *
+  * and choice                                                                     *
+  * @post    the chosen pivot is moved to index mid, with left <= mid <= right     *
+  * @post    elements between left and right are permuted, so that                 *
+  *             a[left], ..., a[mid-1] <= a[mid]                                   *
+  *             a[mid+1], ..., a[right] >= a[mid]                                  *
+  * @post    elements outside left, ..., right are not changed                     *
+  * @returns  mid                                                                  *
+  *********************************************************************************/
+ #define defineNamedPartition(name, pos, scan, swap, choice)                    \
+ int name (int a[ ], int size, int left, int right) {                           \
+   int temp;                                                                    \
+   int mid;                                                                     \
+   (void) temp;                                                                 \
+   choose##choice (at##pos, less##pos)                                          \
+   scanOf##pos##scan (swap, at##pos, less##pos)                                 \
+   return index##pos (mid);                                                     \
+ }
+
+ // the kernel for a combination, named partition<pos><scan><swap><choice>
+ #define definePartition(pos, scan, swap, choice)                               \
+   defineNamedPartition (partition##pos##scan##swap##choice, pos, scan, swap, choice)
+
+ // the cross-product, listed once for both the definitions and the table
+ #define forEachChoice(X, pos, scan, swap)                                      \
+   X (pos, scan, swap, First) X (pos, scan, swap, Random) X (pos, scan, swap, Median3)
+ #define forEachSwap(X, pos, scan)                                              \
+   forEachChoice (X, pos, scan, Temp) forEachChoice (X, pos, scan, Hole)
+ #define forEachScan(X, pos)                                                    \
+   forEachSwap (X, pos, Both) forEachSwap (X, pos, Up) forEachSwap (X, pos, Down)
+ #define forEachPartition(X)                                                    \
+   forEachScan (X, Left) forEachScan (X, Right)
+
+ #endif
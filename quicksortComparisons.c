@@ -1,15 +1,75 @@
 /* program to time several sorting algorithms on data sets of various sizes
  */
 
+ #define _GNU_SOURCE   // for CPU_SET and pthread_setaffinity_np
  #include <stdio.h>
  #include <stdlib.h>   // for malloc, free
  #include <time.h>     // for time
- 
+ #include <limits.h>   // for INT_MIN, INT_MAX
+ #include <unistd.h>   // for sysconf, access
+ #include <pthread.h>  // for threads used by the parallel sorts
+ #include <sched.h>    // for cpu_set_t
+ #include <string.h>   // for memmove, memcpy
+ #include <math.h>     // for pow
+
+ #define useLibnuma 0      // 1 = place threads with libnuma (link with -lnuma)
+                           // 0 = read node layout from /sys and pin with sched affinity
+ #define simulatedNodes 0  // > 0 pretends the machine has this many NUMA nodes
+ #define threadsPerNode 2  // sorting threads started on each NUMA node
+ #define numaMaxSize 8     // insertion sort cutoff for the per-thread hybrid quicksort
+ #define numThreads 4      // threads used by the parallel sorts that are not NUMA-aware
+ #define segInsertionMax 32  // segments up to this length are insertion sorted
+ #define oopMaxSize 16       // out-of-place quicksort insertion sorts segments this short
+ #define ssBuckets 128       // samplesort buckets per level, a power of 2 from 64 to 256
+ #define ssLogBuckets 7      // log2 (ssBuckets), the depth of the splitter tree
+ #define ssBlock 256         // elements in each block the samplesort permutation moves
+ #define ssOversample 16     // samplesort sample elements drawn per bucket
+ #define ssLeafSize 16384    // samplesort hands segments this short to hybrid quicksort
+ #define runBlock 16         // stable mergesort insertion sorts blocks this long
+ #define smartSamples 256        // most pairs and values smart sort samples, and
+                                 // never more than one per 16 elements
+ #define smartInsertionMax 64    // smart sort insertion sorts arrays this short
+ #define smartRunsMax 64         // smart sort merges runs when it estimates this few
+ #define smartInversionDiv 32    // ... or when under 1/32 of sampled pairs are inverted
+ #define smartCountFactor 2      // counting sort when the key range is under 2n
+ #define lazyDeltas 8            // incremental sort test: deltas gathered per lazy merge
+ #define groupLeafSize 32        // group-by insertion sorts ranges this short
+ #define zipfKeys (1 << 20)      // group-by test: distinct keys of the Zipf data
+ #define zipfExponent 1.0        // ... and the skew of their frequencies
+ #define profileTimeMin 4096     // profiler times partitions of ranges this large, and
+                                 // smaller subtrees as a whole
+ #define profileClasses 32       // range size classes 2^0, ..., 2^31
+ #define profileRatios 10        // split ratio histogram buckets
+ #define profileDepthMax 1024    // depths recorded one by one; deeper ones share the last
+ #define profileNodesMax 65536   // most recursion tree nodes kept for the folded stacks
+ #define profileFolded 0         // 1 = write <sort>.folded flamegraph stacks; 0 = do not
+
+ #if useLibnuma
+ #include <numa.h>
+ #endif
+ #include "verify.h"     // SIMD and threaded checks, multiset fingerprints
+ #include "partitionFamily.h"  // macros that generate the partitions below
+
+ void insertionSort (int arr[], int left, int right);
+ void samplesortBucket (int a [ ], long n, long start, long end);
+
+ // partition profiler hooks, called by the quicksort helpers only when they are
+ // given a profile; the profiler is defined with the other test code below
+ typedef struct profile profileType;
+ int profileEnterSubtree (profileType * p, int left, int right);
+ void profileLeaveSubtree (profileType * p);
+ void profileBeforePartition (profileType * p);
+ int profileAfterPartition (profileType * p, int left, int right, int mid);
+ void profileAfterInsertion (profileType * p);
+ void profileLeave (profileType * p, int node);
+
  /* * * * * * * * * * * quicksort and helper functions * * * * * * * * * * */
  
  /** *******************************************************************************
   * procedure implements the partition operation, following Loop Invariant 1a      *
   *    the Reading on Quicksort referenced above                                   *
+  *    generated from partitionFamily.h, the same kernel as                        *
+  *    partitionLeftBothTempFirst, with the pivot at a[left]                       *
   *    in brief: array segment has pivot, then small, unprocessed, large elements  *
   *              both unprocessed endpoints examined, swapping done in line        *
   * @param   a      the array containing the segment to be partitioned             *
@@ -23,34 +83,7 @@
   * @post    elements outside left, ..., right are not changed                     *
   * @returns  mid                                                                  *
  / *********************************************************************************/
- int basicPartition (int a[ ], int size, int left, int right) {
-   int pivot = a[left];
-   int l_spot = left+1;
-   int r_spot = right;
-   int temp;
-   
-   while (l_spot <= r_spot) {
-     while( (l_spot <= r_spot) && (a[r_spot] >= pivot))
-       r_spot--;
-     while ((l_spot <= r_spot) && (a[l_spot] <= pivot)) 
-       l_spot++;
-                            // l_spot = 1, r_spot = 0
-     // if misplaced small and large values found, swap them
-     if (l_spot < r_spot) {
-       temp = a[l_spot];
-       a[l_spot] = a[r_spot];
-       a[r_spot] = temp;
-       l_spot++;
-       r_spot--;
-       }
-   }
- 
-   // swap a[left] with biggest small value
-   temp = a[left];
-   a[left] = a[r_spot];
-   a[r_spot] = temp;
-   return r_spot;
- }
+ defineNamedPartition (basicPartition, Left, Both, Temp, First)
  
  /** *******************************************************************************
   * Quicksort helper function                                                      *
@@ -83,6 +116,8 @@
  /** *******************************************************************************
   * procedure implements the partition operation, following Loop Invariant 1a      *
   *    the Reading on Quicksort referenced above                                   *
+  *    generated from partitionFamily.h, the same kernel as                        *
+  *    partitionLeftBothTempRandom, with a random pivot                            *
   *    in brief: array segment has pivot, then small, unprocessed, large elements  *
   *              both unprocessed endpoints examined, swapping done in line        *
   * @param   a      the array containing the segment to be partitioned             *
@@ -96,40 +131,7 @@
   * @post    elements outside left, ..., right are not changed                     *
   * @returns  mid                                                                  *
  / *********************************************************************************/
- int imprPartition (int a[ ], int size, int left, int right) {
-
-   int temp;
-   int randIndex = left + (rand() % (right - left + 1));
-   temp = a[randIndex];
-   a[randIndex] = a[left];
-   a[left] = temp;
-
-   int pivot = a[left];
-   int l_spot = left+1;
-   int r_spot = right;
-   
-   while (l_spot <= r_spot) {
-     while( (l_spot <= r_spot) && (a[r_spot] >= pivot))
-       r_spot--;
-     while ((l_spot <= r_spot) && (a[l_spot] <= pivot)) 
-       l_spot++;
- 
-     // if misplaced small and large values found, swap them
-     if (l_spot < r_spot) {
-       temp = a[l_spot];
-       a[l_spot] = a[r_spot];
-       a[r_spot] = temp;
-       l_spot++;
-       r_spot--;
-       }
-   }
- 
-  //  swap a[left] with biggest small value
-   temp = a[left];
-   a[left] = a[r_spot];
-   a[r_spot] = temp;
-   return r_spot;
- }
+ defineNamedPartition (imprPartition, Left, Both, Temp, Random)
  
  /** *******************************************************************************
   * Quicksort helper function                                                      *
@@ -137,131 +139,2335 @@
   * @param  size  the size of the array                                            *
   * @param  left  the lower index for items to be processed                        *
   * @param  right the upper index for items to be processed                        *
+  * @param  p  the profile to add the partitions to, or NULL when not profiling    *
   * @post  sorts elements of a between left and right                              *
   *********************************************************************************/
- void imprQuicksortHelper (int a [ ], int size, int left, int right) {
+ void imprQuicksortHelper (int a [ ], int size, int left, int right, profileType * p) {
    if (left > right)
      return;
+   if (p != NULL && profileEnterSubtree (p, left, right)) {
+     imprQuicksortHelper (a, size, left, right, p);   // small subtree, timed whole
+     profileLeaveSubtree (p);
+     return;
+   }
+   if (p != NULL)
+     profileBeforePartition (p);
    int mid = imprPartition (a, size, left, right);
-   imprQuicksortHelper (a, size, left, mid-1);
-   imprQuicksortHelper (a, size, mid+1, right);
+   int node = (p != NULL) ? profileAfterPartition (p, left, right, mid) : 0;
+   imprQuicksortHelper (a, size, left, mid-1, p);
+   imprQuicksortHelper (a, size, mid+1, right, p);
+   if (p != NULL)
+     profileLeave (p, node);
+ }
+ 
+ /** *******************************************************************************
+  * quicksort, main function                                                       *
+  * @param  a  the array to be sorted                                              *
+  * @param  n  the size of the array                                               *
+  * @post  the first n elements of a are sorted in non-descending order            *
+   ********************************************************************************/
+ void imprQuicksort (int a [ ], int n) {
+   imprQuicksortHelper (a, n, 0, n-1, NULL);
+ }
+
+  /* * * * * * * * hybrid quicksort and helper functions * * * * * * * * * * */
+ 
+ /** *******************************************************************************
+  * procedure implements the partition operation, following Loop Invariant 1a      *
+  *    the Reading on Quicksort referenced above                                   *
+  *    generated from partitionFamily.h, the same kernel as                        *
+  *    partitionLeftBothTempRandom, with a random pivot                            *
+  *    in brief: array segment has pivot, then small, unprocessed, large elements  *
+  *              both unprocessed endpoints examined, swapping done in line        *
+  * @param   a      the array containing the segment to be partitioned             *
+  * @param   size   the size of array a                                            *
+  * @param   left   the index of the first array element in the partition          *
+  * @param   right  the index of the last array element in the partitionn          *
+  * @post    a[left] is moved to index mid, with left <= mid <= right              *
+  * @post    elements between left and right are permuted, so that                 *
+  *             a[left], ..., a[mid-1] <= a[mid]                                   *
+  *             a[mid+1], ..., a[right] >= a[mid]                                  *
+  * @post    elements outside left, ..., right are not changed                     *
+  * @returns  mid                                                                  *
+ / *********************************************************************************/
+ defineNamedPartition (hybridPartition, Left, Both, Temp, Random)
+
+/** *******************************************************************************
+ * Quicksort helper function                                                      *
+ * @param  a  the array to be processed                                           *
+ * @param  size  the size of the array                                            *
+ * @param  left  the lower index for items to be processed                        *
+ * @param  right the upper index for items to be processed                        *
+ * @param  p  the profile to add the partitions to, or NULL when not profiling    *
+ * @post  sorts elements of a between left and right                              *
+ *********************************************************************************/
+void hybridQuicksortHelper (int a [ ], int size, int left, int right, const int maxSize,
+                            profileType * p) {
+  if (left > right)
+    return;
+  if (p != NULL && profileEnterSubtree (p, left, right)) {
+    hybridQuicksortHelper (a, size, left, right, maxSize, p);   // small subtree, timed whole
+    profileLeaveSubtree (p);
+    return;
+  }
+  if (p != NULL)
+    profileBeforePartition (p);
+  int mid = hybridPartition (a, size, left, right);
+  int node = (p != NULL) ? profileAfterPartition (p, left, right, mid) : 0;
+  if (mid - left < maxSize){
+    insertionSort(a, left, mid - 1);
+    insertionSort(a, mid + 1, right);
+    if (p != NULL)
+      profileAfterInsertion (p);
+  }
+  else{
+    hybridQuicksortHelper (a, size, left, mid-1, maxSize, p);
+    hybridQuicksortHelper (a, size, mid+1, right, maxSize, p);
+  }
+  if (p != NULL)
+    profileLeave (p, node);
+}
+
+/** *******************************************************************************
+ * quicksort, main function                                                       *
+ * @param  a  the array to be sorted                                              *
+ * @param  n  the size of the array                                               *
+ * @post  the first n elements of a are sorted in non-descending order            *
+  ********************************************************************************/
+void hybridQuicksort (int a [ ], int n, int maxSize) {
+  hybridQuicksortHelper (a, n, 0, n-1, maxSize, NULL);
+}
+
+void insertionSort(int arr[], int left, int right) {
+
+  // Starting from the second element
+  for (int i = left; i <= right; i++) {
+      int key = arr[i];
+      int j = i - 1;
+
+      // Move elements of arr[left..i-1], that are
+        // greater than key, to one position to
+        // the right of their current position
+      while (j >= left && arr[j] > key) {
+          arr[j + 1] = arr[j];
+          j = j - 1;
+      }
+
+      // Move the key to its correct position
+      arr[j + 1] = key;
+  }
+}
+
+ /* * * * * * * * out-of-place quicksort and helper functions * * * * * * * * * * */
+
+ /** *******************************************************************************
+  * procedure implements the partition operation out of place, in the style of    *
+  *    ska_sort and IPS4o                                                          *
+  *    in brief: a random pivot is chosen as in imprPartition; the other elements  *
+  *              are read once, front to back, and each is written both at the     *
+  *              next small slot from the front of dst and the next large slot     *
+  *              from the back; only one cursor moves, so there is no              *
+  *              data-dependent branch                                             *
+  * @param   src    the array containing the segment to be partitioned             *
+  * @param   dst    the array receiving the partitioned segment                    *
+  * @param   left   the index of the first array element in the partition          *
+  * @param   right  the index of the last array element in the partitionn          *
+  * @post    dst[left], ..., dst[right] is a permutation of src[left], ...,        *
+  *          src[right], with the pivot at dst[mid] and                            *
+  *             dst[left], ..., dst[mid-1] <= dst[mid]                             *
+  *             dst[mid+1], ..., dst[right] >= dst[mid]                            *
+  * @post    src[left], ..., src[right] may be permuted                            *
+  * @returns  mid                                                                  *
+  *********************************************************************************/
+ int oopPartition (int src[ ], int dst[ ], int left, int right) {
+   int temp;
+   int randIndex = left + (rand() % (right - left + 1));
+   temp = src[randIndex];
+   src[randIndex] = src[left];
+   src[left] = temp;
+
+   int pivot = src[left];
+   int lo = left;
+   int hi = right;
+   int v, small;
+   for (int i = left + 1; i <= right; i++) {
+     v = src[i];
+     dst[lo] = v;
+     dst[hi] = v;
+     small = (v < pivot) | ((v == pivot) & i);   // ties alternate sides
+     lo += small;
+     hi -= 1 - small;
+   }
+   dst[lo] = pivot;
+   return lo;
+ }
+
+ /** *******************************************************************************
+  * out-of-place quicksort helper function                                         *
+  * @param  a      the array to be sorted                                          *
+  * @param  src    the array holding the current segment, either a or scratch      *
+  * @param  dst    the other one of a and scratch                                  *
+  * @param  left   the lower index for items to be processed                       *
+  * @param  right  the upper index for items to be processed                       *
+  * @post  a[left], ..., a[right] holds the segment in non-descending order;       *
+  *        each level partitions from src into dst and recurses with the roles     *
+  *        swapped, so nothing is copied back until a segment is finished          *
+  *********************************************************************************/
+ void oopQuicksortHelper (int a [ ], int src [ ], int dst [ ], int left, int right) {
+   if (right - left < oopMaxSize) {
+     insertionSort (src, left, right);
+     if (src != a) {
+       for (int i = left; i <= right; i++)
+         a[i] = src[i];
+     }
+     return;
+   }
+   int mid = oopPartition (src, dst, left, right);
+   a[mid] = dst[mid];
+   oopQuicksortHelper (a, dst, src, left, mid-1);
+   oopQuicksortHelper (a, dst, src, mid+1, right);
+ }
+
+ /** *******************************************************************************
+  * out-of-place quicksort, main function                                          *
+  * @param  a        the array to be sorted                                        *
+  * @param  scratch  scratch space for n elements, supplied by the caller          *
+  * @param  n        the size of the array                                         *
+  * @post  the first n elements of a are sorted in non-descending order            *
+  *********************************************************************************/
+ void oopQuicksort (int a [ ], int scratch [ ], int n) {
+   oopQuicksortHelper (a, a, scratch, 0, n-1);
+ }
+
+ /* * * * * * * * NUMA-aware parallel quicksort and helper functions * * * * * * * */
+
+ /** *******************************************************************************
+  * wall clock time, used to time the parallel sorts, since clock() adds together  *
+  * the processor time of every thread                                             *
+  * @returns  seconds since an arbitrary fixed starting point                      *
+  *********************************************************************************/
+ double wallClock ( ) {
+   struct timespec now;
+   clock_gettime (CLOCK_MONOTONIC, &now);
+   return now.tv_sec + now.tv_nsec / 1e9;
+ }
+
+ /** *******************************************************************************
+  * number of NUMA nodes actually present                                          *
+  * @returns  the nodes reported by libnuma or listed in /sys/devices/system/node, *
+  *           and 1 when neither gives an answer                                   *
+  *********************************************************************************/
+ int hardwareNodeCount ( ) {
+ #if useLibnuma
+   if (numa_available () >= 0)
+     return numa_num_configured_nodes ();
+   return 1;
+ #else
+   int nodes = 0;
+   char path [64];
+   for (;;) {
+     sprintf (path, "/sys/devices/system/node/node%d", nodes);
+     if (access (path, F_OK) != 0)
+       break;
+     nodes++;
+   }
+   return (nodes > 0) ? nodes : 1;
+ #endif
+ }
+
+ /** *******************************************************************************
+  * number of NUMA nodes the parallel sorts spread their work over                 *
+  * @returns  simulatedNodes if it is set, otherwise hardwareNodeCount()           *
+  *********************************************************************************/
+ int numaNodeCount ( ) {
+   if (simulatedNodes > 0)
+     return simulatedNodes;
+   return hardwareNodeCount ();
+ }
+
+ /** *******************************************************************************
+  * restrict the calling thread to the processors of one NUMA node                 *
+  * @param  node  the node, simulated nodes wrap around onto the real ones         *
+  * @post  the thread runs only on the processors of the node; if the node layout  *
+  *        cannot be read, the thread is left unpinned                             *
+  *********************************************************************************/
+ void pinToNode (int node) {
+   int hwNode = node % hardwareNodeCount ();
+ #if useLibnuma
+   if (numa_available () >= 0)
+     numa_run_on_node (hwNode);
+ #else
+   char path [64];
+   sprintf (path, "/sys/devices/system/node/node%d/cpulist", hwNode);
+   FILE * cpulist = fopen (path, "r");
+   if (cpulist == NULL)
+     return;
+
+   // cpulist holds ranges such as 0-7,16-23
+   cpu_set_t cpus;
+   CPU_ZERO (&cpus);
+   int lo, hi, sep;
+   while (fscanf (cpulist, "%d", &lo) == 1) {
+     hi = lo;
+     sep = fgetc (cpulist);
+     if (sep == '-') {
+       if (fscanf (cpulist, "%d", &hi) != 1)
+         break;
+       sep = fgetc (cpulist);
+     }
+     for (int cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++)
+       CPU_SET (cpu, &cpus);
+     if (sep != ',')
+       break;
+   }
+   fclose (cpulist);
+
+   if (CPU_COUNT (&cpus) > 0)
+     pthread_setaffinity_np (pthread_self (), sizeof (cpus), &cpus);
+ #endif
+ }
+
+ /** *******************************************************************************
+  * structure giving one thread its share of the first touch of an array           *
+  *********************************************************************************/
+ typedef struct numaTouchArgs {
+   int * a;     // the array being placed
+   long lo;     // first index touched by this thread
+   long hi;     // one past the last index touched by this thread
+   int node;    // the node the thread runs on
+ } numaTouchType;
+
+ void * numaTouchThread (void * arg) {
+   numaTouchType * t = (numaTouchType *) arg;
+   pinToNode (t->node);
+   for (long i = t->lo; i < t->hi; i++)
+     t->a[i] = 0;
+   return NULL;
+ }
+
+ /** *******************************************************************************
+  * allocate an array whose pages are spread over the NUMA nodes by first touch    *
+  * @param  n      the size of the array                                           *
+  * @param  nodes  the number of nodes to spread the array over                    *
+  * @returns  an array of n zeros, in which the k-th of nodes equal slices was     *
+  *           first written by a thread pinned to node k; release with free        *
+  *********************************************************************************/
+ int * numaAllocArray (int n, int nodes) {
+   int * a = (int *) malloc (n * sizeof(int));
+   pthread_t threads [nodes];
+   numaTouchType args [nodes];
+   for (int k = 0; k < nodes; k++) {
+     args[k].a = a;
+     args[k].lo = (long) n * k / nodes;
+     args[k].hi = (long) n * (k + 1) / nodes;
+     args[k].node = k;
+     pthread_create (&threads[k], NULL, numaTouchThread, &args[k]);
+   }
+   for (int k = 0; k < nodes; k++)
+     pthread_join (threads[k], NULL);
+   return a;
+ }
+
+ /** *******************************************************************************
+  * first index in a[lo], ..., a[hi-1] holding a value >= v, or hi if none         *
+  *********************************************************************************/
+ long lowerBound (int a [ ], long lo, long hi, int v) {
+   while (lo < hi) {
+     long mid = lo + (hi - lo) / 2;
+     if (a[mid] < v)
+       lo = mid + 1;
+     else
+       hi = mid;
+   }
+   return lo;
+ }
+
+ /** *******************************************************************************
+  * first index in a[lo], ..., a[hi-1] holding a value > v, or hi if none          *
+  *********************************************************************************/
+ long upperBound (int a [ ], long lo, long hi, int v) {
+   while (lo < hi) {
+     long mid = lo + (hi - lo) / 2;
+     if (a[mid] <= v)
+       lo = mid + 1;
+     else
+       hi = mid;
+   }
+   return lo;
+ }
+
+ /** *******************************************************************************
+  * splits several sorted runs so the pieces before the split hold exactly the    *
+  * rank smallest elements of all the runs together                                *
+  * @param  a         the array holding the runs                                   *
+  * @param  runStart  run j is a[runStart[j]], ..., a[runStart[j+1]-1]             *
+  * @param  runs      the number of runs                                           *
+  * @param  rank      the number of elements that go before the split              *
+  * @param  split     receives, for each run j, the index of its first element     *
+  *                   after the split                                              *
+  * @post  ties are given to earlier runs first, so merging the pieces in run     *
+  *        order keeps equal values in their original order                        *
+  *********************************************************************************/
+ void multiwaySplit (int a [ ], long runStart [ ], int runs, long rank, long split [ ]) {
+   // smallest value v that has at least rank elements <= v
+   long long lo = INT_MIN;
+   long long hi = INT_MAX;
+   while (lo < hi) {
+     long long mid = lo + (hi - lo) / 2;
+     long count = 0;
+     for (int j = 0; j < runs; j++)
+       count += upperBound (a, runStart[j], runStart[j+1], (int) mid) - runStart[j];
+     if (count >= rank)
+       hi = mid;
+     else
+       lo = mid + 1;
+   }
+
+   // take everything below v, then copies of v from the earliest runs
+   long remaining = rank;
+   for (int j = 0; j < runs; j++) {
+     split[j] = lowerBound (a, runStart[j], runStart[j+1], (int) lo);
+     remaining -= split[j] - runStart[j];
+   }
+   for (int j = 0; j < runs && remaining > 0; j++) {
+     long equal = upperBound (a, split[j], runStart[j+1], (int) lo) - split[j];
+     long take = (equal < remaining) ? equal : remaining;
+     split[j] += take;
+     remaining -= take;
+   }
+ }
+
+ /** *******************************************************************************
+  * merge pieces of several sorted runs into one sorted sequence                   *
+  * @param  a     the array holding the runs                                       *
+  * @param  from  from[j] is the first index of the piece of run j                 *
+  * @param  to    to[j] is one past the last index of the piece of run j           *
+  * @param  runs  the number of runs                                               *
+  * @param  out   receives the merged pieces                                       *
+  * @post  of equal values, the one from the earlier run is placed first           *
+  *********************************************************************************/
+ void multiwayMerge (int a [ ], long from [ ], long to [ ], int runs, int out [ ]) {
+   long pos [runs];
+   for (int j = 0; j < runs; j++)
+     pos[j] = from[j];
+
+   for (long o = 0; ; o++) {
+     int best = -1;
+     for (int j = 0; j < runs; j++) {
+       if (pos[j] < to[j] && (best < 0 || a[pos[j]] < a[pos[best]]))
+         best = j;
+     }
+     if (best < 0)
+       return;
+     out[o] = a[pos[best]++];
+   }
+ }
+
+ /** *******************************************************************************
+  * structure describing the work of one thread of the NUMA-aware quicksort        *
+  *********************************************************************************/
+ typedef struct numaSortArgs {
+   int * a;                      // the array being sorted
+   int * buf;                    // scratch array the runs are merged into
+   long * runStart;              // run t is a[runStart[t]], ..., a[runStart[t+1]-1]
+   int runs;                     // the number of runs, one per thread
+   int id;                       // the run sorted by this thread
+   int node;                     // the node this thread is pinned to
+   pthread_barrier_t * barrier;  // shared by all threads of one sort
+ } numaSortType;
+
+ /** *******************************************************************************
+  * one thread of the NUMA-aware quicksort                                         *
+  * @post  the thread sorts its own run with hybrid quicksort, then merges the     *
+  *        slice of the final order with the same bounds as that run, so every     *
+  *        thread reads and writes mostly memory on its own node                   *
+  *********************************************************************************/
+ void * numaSortThread (void * arg) {
+   numaSortType * t = (numaSortType *) arg;
+   pinToNode (t->node);
+   long lo = t->runStart[t->id];
+   long hi = t->runStart[t->id + 1];
+
+   hybridQuicksort (t->a + lo, hi - lo, numaMaxSize);
+   pthread_barrier_wait (t->barrier);
+
+   long from [t->runs];
+   long to [t->runs];
+   multiwaySplit (t->a, t->runStart, t->runs, lo, from);
+   multiwaySplit (t->a, t->runStart, t->runs, hi, to);
+   multiwayMerge (t->a, from, to, t->runs, t->buf + lo);
+   pthread_barrier_wait (t->barrier);
+
+   for (long i = lo; i < hi; i++)
+     t->a[i] = t->buf[i];
+   return NULL;
+ }
+
+ /** *******************************************************************************
+  * NUMA-aware parallel quicksort, main function                                   *
+  * @param  a      the array to be sorted, ideally from numaAllocArray (n, nodes)  *
+  * @param  n      the size of the array                                           *
+  * @param  nodes  the number of NUMA nodes to use, see numaNodeCount              *
+  * @post  the first n elements of a are sorted in non-descending order            *
+  *********************************************************************************/
+ void numaQuicksort (int a [ ], int n, int nodes) {
+   int runs = nodes * threadsPerNode;
+   int * buf = (int *) malloc (n * sizeof(int));  // first touched by the merging threads
+   long runStart [runs + 1];
+   pthread_t threads [runs];
+   numaSortType args [runs];
+   pthread_barrier_t barrier;
+
+   pthread_barrier_init (&barrier, NULL, runs);
+   for (int t = 0; t <= runs; t++)
+     runStart[t] = (long) n * t / runs;
+   for (int t = 0; t < runs; t++) {
+     args[t].a = a;
+     args[t].buf = buf;
+     args[t].runStart = runStart;
+     args[t].runs = runs;
+     args[t].id = t;
+     args[t].node = t / threadsPerNode;
+     args[t].barrier = &barrier;
+     pthread_create (&threads[t], NULL, numaSortThread, &args[t]);
+   }
+   for (int t = 0; t < runs; t++)
+     pthread_join (threads[t], NULL);
+
+   pthread_barrier_destroy (&barrier);
+   free (buf);
+ }
+
+ /* * * * * * * * stable parallel multiway mergesort and helper functions * * * * * * * */
+
+ /** *******************************************************************************
+  * structure for a record sorted by key, with a payload that travels with it;    *
+  * the stable sort keeps records with equal keys in their original order          *
+  *********************************************************************************/
+ typedef struct record {
+   int key;
+   int payload;
+ } recordType;
+
+ /** *******************************************************************************
+  * first index in r[lo], ..., r[hi-1] with key >= v, or hi if none                *
+  *********************************************************************************/
+ long recordLowerBound (recordType r [ ], long lo, long hi, int v) {
+   while (lo < hi) {
+     long mid = lo + (hi - lo) / 2;
+     if (r[mid].key < v)
+       lo = mid + 1;
+     else
+       hi = mid;
+   }
+   return lo;
+ }
+
+ /** *******************************************************************************
+  * first index in r[lo], ..., r[hi-1] with key > v, or hi if none                 *
+  *********************************************************************************/
+ long recordUpperBound (recordType r [ ], long lo, long hi, int v) {
+   while (lo < hi) {
+     long mid = lo + (hi - lo) / 2;
+     if (r[mid].key <= v)
+       lo = mid + 1;
+     else
+       hi = mid;
+   }
+   return lo;
+ }
+
+ /** *******************************************************************************
+  * record version of multiwaySplit: splits sorted runs of records so the pieces   *
+  * before the split hold the rank smallest records, ties going to earlier runs    *
+  *********************************************************************************/
+ void recordMultiwaySplit (recordType r [ ], long runStart [ ], int runs, long rank, long split [ ]) {
+   // smallest key v that has at least rank records with key <= v
+   long long lo = INT_MIN;
+   long long hi = INT_MAX;
+   while (lo < hi) {
+     long long mid = lo + (hi - lo) / 2;
+     long count = 0;
+     for (int j = 0; j < runs; j++)
+       count += recordUpperBound (r, runStart[j], runStart[j+1], (int) mid) - runStart[j];
+     if (count >= rank)
+       hi = mid;
+     else
+       lo = mid + 1;
+   }
+
+   // take every key below v, then records with key v from the earliest runs
+   long remaining = rank;
+   for (int j = 0; j < runs; j++) {
+     split[j] = recordLowerBound (r, runStart[j], runStart[j+1], (int) lo);
+     remaining -= split[j] - runStart[j];
+   }
+   for (int j = 0; j < runs && remaining > 0; j++) {
+     long equal = recordUpperBound (r, split[j], runStart[j+1], (int) lo) - split[j];
+     long take = (equal < remaining) ? equal : remaining;
+     split[j] += take;
+     remaining -= take;
+   }
+ }
+
+ /** *******************************************************************************
+  * record version of multiwayMerge: of equal keys, the record from the earlier    *
+  * run is placed first                                                            *
+  *********************************************************************************/
+ void recordMultiwayMerge (recordType r [ ], long from [ ], long to [ ], int runs, recordType out [ ]) {
+   long pos [runs];
+   for (int j = 0; j < runs; j++)
+     pos[j] = from[j];
+
+   for (long o = 0; ; o++) {
+     int best = -1;
+     for (int j = 0; j < runs; j++) {
+       if (pos[j] < to[j] && (best < 0 || r[pos[j]].key < r[pos[best]].key))
+         best = j;
+     }
+     if (best < 0)
+       return;
+     out[o] = r[pos[best]++];
+   }
+ }
+
+ /** *******************************************************************************
+  * stable sort of one run of records, bottom-up mergesort over insertion-sorted   *
+  * blocks                                                                         *
+  * @param  r        the run to be sorted                                          *
+  * @param  scratch  scratch space for n records                                   *
+  * @param  n        the number of records in the run                              *
+  * @post  scratch[0], ..., scratch[n-1] holds the run in non-descending key       *
+  *        order, records with equal keys in their original order                  *
+  *********************************************************************************/
+ void recordMergesortRun (recordType r [ ], recordType scratch [ ], long n) {
+   for (long lo = 0; lo < n; lo += runBlock) {
+     long hi = (lo + runBlock < n) ? lo + runBlock : n;
+     for (long i = lo + 1; i < hi; i++) {
+       recordType key = r[i];
+       long j = i - 1;
+       while (j >= lo && r[j].key > key.key) {
+         r[j + 1] = r[j];
+         j--;
+       }
+       r[j + 1] = key;
+     }
+   }
+
+   // merge pairs of sorted blocks, passing back and forth between r and scratch
+   recordType * src = r;
+   recordType * dst = scratch;
+   for (long width = runBlock; width < n; width *= 2) {
+     for (long lo = 0; lo < n; lo += 2 * width) {
+       long mid = (lo + width < n) ? lo + width : n;
+       long hi = (lo + 2 * width < n) ? lo + 2 * width : n;
+       long i = lo, j = mid, o = lo;
+       while (i < mid && j < hi)
+         dst[o++] = (src[j].key < src[i].key) ? src[j++] : src[i++];
+       while (i < mid)
+         dst[o++] = src[i++];
+       while (j < hi)
+         dst[o++] = src[j++];
+     }
+     recordType * temp = src;
+     src = dst;
+     dst = temp;
+   }
+
+   if (src != scratch) {
+     for (long i = 0; i < n; i++)
+       scratch[i] = src[i];
+   }
+ }
+
+ /** *******************************************************************************
+  * structure describing the work of one thread of the multiway mergesort          *
+  *********************************************************************************/
+ typedef struct mergesortArgs {
+   recordType * r;               // the records being sorted
+   recordType * scratch;         // scratch space the sorted runs are left in
+   long * runStart;              // run t is r[runStart[t]], ..., r[runStart[t+1]-1]
+   int runs;                     // the number of runs, one per thread
+   int id;                       // the run sorted by this thread
+   pthread_barrier_t * barrier;  // shared by all threads of one sort
+ } mergesortType;
+
+ /** *******************************************************************************
+  * one thread of the multiway mergesort                                           *
+  * @post  the thread sorts its own run into scratch, then merges the slice of the *
+  *        final order with the same bounds as its run back into r                 *
+  *********************************************************************************/
+ void * mergesortThread (void * arg) {
+   mergesortType * t = (mergesortType *) arg;
+   long lo = t->runStart[t->id];
+   long hi = t->runStart[t->id + 1];
+
+   recordMergesortRun (t->r + lo, t->scratch + lo, hi - lo);
+   pthread_barrier_wait (t->barrier);
+
+   long from [t->runs];
+   long to [t->runs];
+   recordMultiwaySplit (t->scratch, t->runStart, t->runs, lo, from);
+   recordMultiwaySplit (t->scratch, t->runStart, t->runs, hi, to);
+   recordMultiwayMerge (t->scratch, from, to, t->runs, t->r + lo);
+   return NULL;
+ }
+
+ /** *******************************************************************************
+  * stable parallel multiway mergesort, main function                              *
+  * @param  r        the records to be sorted                                      *
+  * @param  scratch  preallocated scratch space for n records                      *
+  * @param  n        the number of records                                         *
+  * @param  threads  the number of threads, each sorting one run                   *
+  * @post  the first n records of r are in non-descending key order, and records  *
+  *        with equal keys keep their original order                               *
+  *********************************************************************************/
+ void multiwayMergesort (recordType r [ ], recordType scratch [ ], int n, int threads) {
+   long runStart [threads + 1];
+   pthread_t thread [threads];
+   mergesortType args [threads];
+   pthread_barrier_t barrier;
+
+   pthread_barrier_init (&barrier, NULL, threads);
+   for (int t = 0; t <= threads; t++)
+     runStart[t] = (long) n * t / threads;
+   for (int t = 0; t < threads; t++) {
+     args[t].r = r;
+     args[t].scratch = scratch;
+     args[t].runStart = runStart;
+     args[t].runs = threads;
+     args[t].id = t;
+     args[t].barrier = &barrier;
+     pthread_create (&thread[t], NULL, mergesortThread, &args[t]);
+   }
+   for (int t = 0; t < threads; t++)
+     pthread_join (thread[t], NULL);
+   pthread_barrier_destroy (&barrier);
+ }
+
+ /* * * * * * * * in-place parallel samplesort and helper functions * * * * * * * * */
+
+ /** *******************************************************************************
+  * structure shared by the threads partitioning one array for samplesort          *
+  * @remark  blocks are ssBlock elements long and slot s is a[s*ssBlock], ...,     *
+  *          a[s*ssBlock + ssBlock-1]; bucket b owns slots from                    *
+  *          ceiling (bucketStart[b] / ssBlock) up to that of bucketStart[b+1]     *
+  *********************************************************************************/
+ typedef struct samplesortShared {
+   int * a;                          // the array being partitioned
+   long n;                           // the size of the array
+   int threads;                      // the number of threads sharing the work
+   int tree [ssBuckets];             // splitter tree, root at tree[1]
+   long * stripe;                    // thread t classifies a[stripe[t]], ..., a[stripe[t+1]-1]
+   long * written;                   // full blocks of thread t end at a[written[t]-1]
+   int * buffers;                    // ssBuckets buffers of ssBlock elements per thread
+   long * count;                     // count[t*ssBuckets+b] elements of bucket b seen by thread t
+   int * fill;                       // fill[t*ssBuckets+b] elements left in thread t's buffer
+   long bucketStart [ssBuckets + 1]; // bucket b ends up in a[bucketStart[b]], ...
+   long slotStart [ssBuckets + 1];   // first slot owned by each bucket
+   long w [ssBuckets];               // next slot of each bucket to receive a block
+   long r [ssBuckets];               // last slot of each bucket holding an unplaced block
+   pthread_mutex_t lock [ssBuckets]; // guards w and r of each bucket
+   int overflow [ssBlock];           // receives a block meant for the slot past the end
+   long overflowSlot;                // that slot, or -1 when overflow is unused
+   int saved [ssBuckets][ssBlock];   // elements a bucket's last block wrote past its end
+   int savedCount [ssBuckets];
+   pthread_barrier_t barrier;
+ } samplesortShared;
+
+ typedef struct samplesortArgs {
+   samplesortShared * sh;
+   int id;
+ } samplesortType;
+
+ /** *******************************************************************************
+  * find the bucket of a value by descending the splitter tree, with no branch     *
+  * that depends on the data                                                       *
+  * @returns  the number of splitters less than x                                  *
+  *********************************************************************************/
+ int ssClassify (int tree [ ], int x) {
+   int j = 1;
+   for (int level = 0; level < ssLogBuckets; level++)
+     j = 2 * j + (x > tree[j]);
+   return j - ssBuckets;
+ }
+
+ /** *******************************************************************************
+  * store sorted splitters lo, ..., hi as the subtree rooted at node               *
+  *********************************************************************************/
+ void ssBuildTree (int tree [ ], int splitters [ ], int node, int lo, int hi) {
+   int mid = (lo + hi) / 2;
+   tree[node] = splitters[mid];
+   if (lo < hi) {
+     ssBuildTree (tree, splitters, 2 * node, lo, mid - 1);
+     ssBuildTree (tree, splitters, 2 * node + 1, mid + 1, hi);
+   }
+ }
+
+ /** *******************************************************************************
+  * does slot s hold a full block after the local classification?                  *
+  *********************************************************************************/
+ int ssSlotFull (samplesortShared * sh, long s) {
+   long pos = s * ssBlock;
+   int t = 0;
+   while (pos >= sh->stripe[t + 1])
+     t++;
+   return pos + ssBlock <= sh->written[t];
+ }
+
+ /** *******************************************************************************
+  * value at position p once the blocks are placed, reading the overflow block     *
+  * for positions in the slot past the end of the array                            *
+  *********************************************************************************/
+ int ssPlacedValue (samplesortShared * sh, long p) {
+   if (sh->overflowSlot >= 0 && p >= sh->overflowSlot * ssBlock)
+     return sh->overflow[p - sh->overflowSlot * ssBlock];
+   return sh->a[p];
+ }
+
+ /** *******************************************************************************
+  * write a block to a slot, or to the overflow block if the slot runs past the    *
+  * end of the array                                                               *
+  *********************************************************************************/
+ void ssWriteBlock (samplesortShared * sh, long s, int block [ ]) {
+   int * dst = sh->a + s * ssBlock;
+   if ((s + 1) * ssBlock > sh->n) {
+     dst = sh->overflow;
+     sh->overflowSlot = s;
+   }
+   for (int i = 0; i < ssBlock; i++)
+     dst[i] = block[i];
+ }
+
+ /** *******************************************************************************
+  * thread 0 only: bucket bounds from the counts of every thread                   *
+  *********************************************************************************/
+ void ssComputeBounds (samplesortShared * sh) {
+   sh->bucketStart[0] = 0;
+   for (int b = 0; b < ssBuckets; b++) {
+     long size = 0;
+     for (int t = 0; t < sh->threads; t++)
+       size += sh->count[t * ssBuckets + b];
+     sh->bucketStart[b + 1] = sh->bucketStart[b] + size;
+   }
+   for (int b = 0; b <= ssBuckets; b++)
+     sh->slotStart[b] = (sh->bucketStart[b] + ssBlock - 1) / ssBlock;
+   sh->overflowSlot = -1;
+ }
+
+ /** *******************************************************************************
+  * move the full blocks inside the slots of bucket b ahead of the empty ones,     *
+  * since a bucket's slots can cover the end of one stripe and the start of the    *
+  * next; sets w and r of the bucket for the block permutation                     *
+  *********************************************************************************/
+ void ssGatherRegion (samplesortShared * sh, int b) {
+   long lo = sh->slotStart[b];
+   long hi = sh->slotStart[b + 1] - 1;
+   long full = 0;
+   for (long s = lo; s <= hi; s++)
+     full += ssSlotFull (sh, s);
+
+   while (lo < hi) {
+     while (lo < hi && ssSlotFull (sh, lo))
+       lo++;
+     while (lo < hi && !ssSlotFull (sh, hi))
+       hi--;
+     if (lo < hi) {
+       for (int i = 0; i < ssBlock; i++)
+         sh->a[lo * ssBlock + i] = sh->a[hi * ssBlock + i];
+       lo++;
+       hi--;
+     }
+   }
+   sh->w[b] = sh->slotStart[b];
+   sh->r[b] = sh->slotStart[b] + full - 1;
+ }
+
+ /** *******************************************************************************
+  * block permutation: take unplaced blocks and swap each into the next free slot  *
+  * of its bucket, following the chain of displaced blocks until a block lands in  *
+  * an empty slot                                                                  *
+  *********************************************************************************/
+ void ssPermuteBlocks (samplesortShared * sh, int id) {
+   int swap [2][ssBlock];
+   for (int step = 0; step < ssBuckets; step++) {
+     int p = (id * ssBuckets / sh->threads + step) % ssBuckets;
+     for (;;) {
+       pthread_mutex_lock (&sh->lock[p]);
+       if (sh->r[p] < sh->w[p]) {
+         pthread_mutex_unlock (&sh->lock[p]);
+         break;
+       }
+       long src = sh->r[p]--;
+       for (int i = 0; i < ssBlock; i++)
+         swap[0][i] = sh->a[src * ssBlock + i];
+       pthread_mutex_unlock (&sh->lock[p]);
+
+       int cur = 0;
+       int occupied;
+       do {
+         int d = ssClassify (sh->tree, swap[cur][0]);
+         pthread_mutex_lock (&sh->lock[d]);
+         long dest = sh->w[d]++;
+         occupied = (dest <= sh->r[d]);
+         if (occupied) {
+           for (int i = 0; i < ssBlock; i++)
+             swap[1 - cur][i] = sh->a[dest * ssBlock + i];
+         }
+         pthread_mutex_unlock (&sh->lock[d]);
+         ssWriteBlock (sh, dest, swap[cur]);
+         cur = 1 - cur;
+       } while (occupied);
+     }
+   }
+ }
+
+ /** *******************************************************************************
+  * the last block of bucket b may run into the start of the next bucket; keep     *
+  * those elements before that bucket overwrites them                              *
+  *********************************************************************************/
+ void ssSaveOverflow (samplesortShared * sh, int b) {
+   long blocksEnd = sh->w[b] * ssBlock;
+   long end = sh->bucketStart[b + 1];
+   sh->savedCount[b] = 0;
+   if (sh->w[b] > sh->slotStart[b] && blocksEnd > end) {
+     for (long p = end; p < blocksEnd; p++)
+       sh->saved[b][sh->savedCount[b]++] = ssPlacedValue (sh, p);
+   }
+ }
+
+ /** *******************************************************************************
+  * fill the positions of bucket b not covered by its blocks with the elements     *
+  * kept by ssSaveOverflow and those left in the threads' buffers                  *
+  *********************************************************************************/
+ void ssFillBucket (samplesortShared * sh, int b) {
+   long start = sh->bucketStart[b];
+   long end = sh->bucketStart[b + 1];
+   long blocksStart = sh->slotStart[b] * ssBlock;
+   long blocksEnd = sh->w[b] * ssBlock;
+   if (sh->w[b] == sh->slotStart[b])
+     blocksStart = blocksEnd = end;
+
+   // the part of an overflow block that belongs inside the array
+   if (sh->overflowSlot >= 0 && sh->overflowSlot >= sh->slotStart[b] && sh->overflowSlot < sh->w[b]) {
+     for (long p = sh->overflowSlot * ssBlock; p < end; p++)
+       sh->a[p] = sh->overflow[p - sh->overflowSlot * ssBlock];
+   }
+
+   long p = start;
+   int t = 0;
+   int i = 0;
+   int * src = sh->saved[b];
+   int srcCount = sh->savedCount[b];
+   while (p < end) {
+     if (p == blocksStart) {
+       p = (blocksEnd < end) ? blocksEnd : end;
+       continue;
+     }
+     while (i == srcCount) {
+       src = sh->buffers + ((long) t * ssBuckets + b) * ssBlock;
+       srcCount = sh->fill[t * ssBuckets + b];
+       i = 0;
+       t++;
+     }
+     sh->a[p++] = src[i++];
+   }
+ }
+
+ /** *******************************************************************************
+  * one thread of the samplesort partitioning step                                 *
+  * @post  after all threads finish, bucket b occupies a[bucketStart[b]], ...,     *
+  *        a[bucketStart[b+1]-1], every element of it greater than the splitter    *
+  *        before it and no greater than the splitter after it                     *
+  *********************************************************************************/
+ void * samplesortThread (void * arg) {
+   samplesortShared * sh = ((samplesortType *) arg)->sh;
+   int id = ((samplesortType *) arg)->id;
+   int T = sh->threads;
+   int * a = sh->a;
+
+   // classify the stripe into buffers, flushing full buffers as blocks at the
+   // front of the stripe, behind the elements still to be read
+   int * buf = sh->buffers + (long) id * ssBuckets * ssBlock;
+   int * fill = sh->fill + id * ssBuckets;
+   long * count = sh->count + id * ssBuckets;
+   long write = sh->stripe[id];
+   for (int b = 0; b < ssBuckets; b++) {
+     fill[b] = 0;
+     count[b] = 0;
+   }
+   for (long i = sh->stripe[id]; i < sh->stripe[id + 1]; i++) {
+     int x = a[i];
+     int b = ssClassify (sh->tree, x);
+     buf[b * ssBlock + fill[b]++] = x;
+     count[b]++;
+     if (fill[b] == ssBlock) {
+       for (int j = 0; j < ssBlock; j++)
+         a[write + j] = buf[b * ssBlock + j];
+       write += ssBlock;
+       fill[b] = 0;
+     }
+   }
+   sh->written[id] = write;
+   pthread_barrier_wait (&sh->barrier);
+
+   if (id == 0)
+     ssComputeBounds (sh);
+   pthread_barrier_wait (&sh->barrier);
+
+   for (int b = id; b < ssBuckets; b += T)
+     ssGatherRegion (sh, b);
+   pthread_barrier_wait (&sh->barrier);
+
+   ssPermuteBlocks (sh, id);
+   pthread_barrier_wait (&sh->barrier);
+
+   for (int b = id; b < ssBuckets; b += T)
+     ssSaveOverflow (sh, b);
+   pthread_barrier_wait (&sh->barrier);
+
+   for (int b = id; b < ssBuckets; b += T)
+     ssFillBucket (sh, b);
+   return NULL;
+ }
+
+ /** *******************************************************************************
+  * samplesort partitioning step: split a into ssBuckets buckets in place          *
+  * @param  a          the array to be partitioned                                 *
+  * @param  n          the size of the array, at least ssLeafSize                  *
+  * @param  threads    the number of threads sharing the work                      *
+  * @param  bucketEnd  receives, for each bucket b, one past its last index        *
+  * @post  the buckets are in order, and a[0], ..., a[n-1] is a permutation of     *
+  *        the original elements                                                   *
+  *********************************************************************************/
+ void samplesortPartition (int a [ ], long n, int threads, long bucketEnd [ ]) {
+   samplesortShared * sh = (samplesortShared *) malloc (sizeof(samplesortShared));
+   long stripe [threads + 1];
+   long written [threads];
+   sh->a = a;
+   sh->n = n;
+   sh->threads = threads;
+   sh->stripe = stripe;
+   sh->written = written;
+   sh->buffers = (int *) malloc ((long) threads * ssBuckets * ssBlock * sizeof(int));
+   sh->count = (long *) malloc (threads * ssBuckets * sizeof(long));
+   sh->fill = (int *) malloc (threads * ssBuckets * sizeof(int));
+
+   // splitters from a sorted random sample, every ssOversample-th one
+   int sampleSize = ssBuckets * ssOversample;
+   int * sample = (int *) malloc (sampleSize * sizeof(int));
+   for (int i = 0; i < sampleSize; i++)
+     sample[i] = a[rand() % n];
+   hybridQuicksort (sample, sampleSize, numaMaxSize);
+   int splitters [ssBuckets - 1];
+   for (int i = 0; i < ssBuckets - 1; i++)
+     splitters[i] = sample[(i + 1) * ssOversample - 1];
+   ssBuildTree (sh->tree, splitters, 1, 0, ssBuckets - 2);
+   free (sample);
+
+   // stripes start on block boundaries
+   for (int t = 0; t < threads; t++)
+     stripe[t] = (n * t / threads) / ssBlock * ssBlock;
+   stripe[threads] = n;
+
+   for (int b = 0; b < ssBuckets; b++)
+     pthread_mutex_init (&sh->lock[b], NULL);
+   pthread_barrier_init (&sh->barrier, NULL, threads);
+   pthread_t thread [threads];
+   samplesortType args [threads];
+   for (int t = 0; t < threads; t++) {
+     args[t].sh = sh;
+     args[t].id = t;
+     if (t > 0)
+       pthread_create (&thread[t], NULL, samplesortThread, &args[t]);
+   }
+   samplesortThread (&args[0]);
+   for (int t = 1; t < threads; t++)
+     pthread_join (thread[t], NULL);
+
+   for (int b = 0; b < ssBuckets; b++) {
+     bucketEnd[b] = sh->bucketStart[b + 1];
+     pthread_mutex_destroy (&sh->lock[b]);
+   }
+   pthread_barrier_destroy (&sh->barrier);
+   free (sh->buffers);
+   free (sh->count);
+   free (sh->fill);
+   free (sh);
+ }
+
+ /** *******************************************************************************
+  * are a[0], ..., a[n-1] all the same value?                                      *
+  *********************************************************************************/
+ int samplesortAllEqual (int a [ ], long n) {
+   for (long i = 1; i < n; i++) {
+     if (a[i] != a[0])
+       return 0;
+   }
+   return 1;
+ }
+
+ /** *******************************************************************************
+  * samplesort helper function, sorting one segment on the calling thread          *
+  * @param  a  the segment to be sorted                                            *
+  * @param  n  the size of the segment                                             *
+  * @post  a[0], ..., a[n-1] are in non-descending order; segments up to           *
+  *        ssLeafSize go to hybrid quicksort                                       *
+  *********************************************************************************/
+ void samplesortHelper (int a [ ], long n) {
+   if (n <= ssLeafSize) {
+     hybridQuicksort (a, n, numaMaxSize);
+     return;
+   }
+   long bucketEnd [ssBuckets];
+   samplesortPartition (a, n, 1, bucketEnd);
+   long start = 0;
+   for (int b = 0; b < ssBuckets; b++) {
+     samplesortBucket (a, n, start, bucketEnd[b]);
+     start = bucketEnd[b];
+   }
+ }
+
+ /** *******************************************************************************
+  * sort one bucket left by samplesortPartition                                    *
+  * @param  a      the partitioned array                                           *
+  * @param  n      the size of the partitioned array                               *
+  * @param  start  the index of the first element of the bucket                    *
+  * @param  end    one past the index of the last element of the bucket            *
+  * @post  the bucket is sorted; a bucket holding the whole array means the sample *
+  *        could not split it, so it is done if all equal and otherwise left to    *
+  *        hybrid quicksort                                                        *
+  *********************************************************************************/
+ void samplesortBucket (int a [ ], long n, long start, long end) {
+   if (end - start < n)
+     samplesortHelper (a + start, end - start);
+   else if (!samplesortAllEqual (a, n))
+     hybridQuicksort (a, n, numaMaxSize);
+ }
+
+ /** *******************************************************************************
+  * structure shared by the threads sorting the buckets of the first level         *
+  *********************************************************************************/
+ typedef struct samplesortBucketArgs {
+   int * a;           // the partitioned array
+   long n;            // the size of the array
+   long * bucketEnd;  // bucket b ends at a[bucketEnd[b]-1]
+   int next;          // the next bucket not yet taken by a thread
+ } samplesortBucketType;
+
+ void * samplesortBucketThread (void * arg) {
+   samplesortBucketType * s = (samplesortBucketType *) arg;
+   int b;
+   while ((b = __sync_fetch_and_add (&s->next, 1)) < ssBuckets)
+     samplesortBucket (s->a, s->n, (b > 0) ? s->bucketEnd[b - 1] : 0, s->bucketEnd[b]);
+   return NULL;
+ }
+
+ /** *******************************************************************************
+  * in-place parallel samplesort in the style of IPS4o, main function              *
+  * @param  a        the array to be sorted                                        *
+  * @param  n        the size of the array                                         *
+  * @param  threads  the number of threads                                         *
+  * @post  the first n elements of a are sorted in non-descending order           *
+  * @remark  one pass splits the array into ssBuckets buckets, so an array of      *
+  *          40 million elements takes about two passes plus the leaves instead    *
+  *          of the 25 or so levels of binary quicksort; besides the array, memory *
+  *          is only ssBuckets blocks per thread and one block per bucket          *
+  *********************************************************************************/
+ void samplesort (int a [ ], int n, int threads) {
+   if (n <= ssLeafSize) {
+     hybridQuicksort (a, n, numaMaxSize);
+     return;
+   }
+   long bucketEnd [ssBuckets];
+   samplesortPartition (a, n, threads, bucketEnd);
+
+   // buckets are taken one at a time, so a thread with small buckets takes more
+   samplesortBucketType shared = {a, n, bucketEnd, 0};
+   pthread_t thread [threads];
+   for (int t = 1; t < threads; t++)
+     pthread_create (&thread[t], NULL, samplesortBucketThread, &shared);
+   samplesortBucketThread (&shared);
+   for (int t = 1; t < threads; t++)
+     pthread_join (thread[t], NULL);
+ }
+
+
+ /* * * * * * * * adaptive sort selection and helper functions * * * * * * * * * * */
+
+ /** *******************************************************************************
+  * reverse a[left], ..., a[right]                                                 *
+  *********************************************************************************/
+ void reverseSegment (int a [ ], int left, int right) {
+   int temp;
+   while (left < right) {
+     temp = a[left];
+     a[left] = a[right];
+     a[right] = temp;
+     left++;
+     right--;
+   }
+ }
+
+ /** *******************************************************************************
+  * @returns  1 if a[0] >= a[1] >= ... >= a[n-1], 0 if not                         *
+  *********************************************************************************/
+ int nonIncreasing (int a [ ], int n) {
+   for (int i = 1; i < n; i++) {
+     if (a[i] > a[i-1])
+       return 0;
+   }
+   return 1;
+ }
+
+ /** *******************************************************************************
+  * natural mergesort, for input made of a few long runs                           *
+  * @param  a  the array to be sorted                                              *
+  * @param  n  the size of the array                                               *
+  * @post  the first n elements of a are sorted in non-descending order; the       *
+  *        ascending and strictly descending runs already present are found in     *
+  *        one pass and merged pairwise, so sorted or reversed input costs one     *
+  *        pass                                                                    *
+  *********************************************************************************/
+ void runMergeSort (int a [ ], int n) {
+   if (n < 2)
+     return;
+
+   // find the runs, turning descending runs around
+   int runs = 0;
+   int * runStart = (int *) malloc ((n + 1) * sizeof(int));
+   int i = 0;
+   while (i < n) {
+     int j = i + 1;
+     if (j < n && a[j] < a[i]) {
+       while (j < n && a[j] < a[j-1])
+         j++;
+       reverseSegment (a, i, j - 1);
+     }
+     else {
+       while (j < n && a[j] >= a[j-1])
+         j++;
+     }
+     runStart[runs++] = i;
+     i = j;
+   }
+   runStart[runs] = n;
+   if (runs == 1) {
+     free (runStart);
+     return;
+   }
+
+   // merge neighbouring runs, passing back and forth between a and buf
+   int * buf = (int *) malloc (n * sizeof(int));
+   int * src = a;
+   int * dst = buf;
+   while (runs > 1) {
+     int merged = 0;
+     for (int r = 0; r < runs; r += 2) {
+       int lo = runStart[r];
+       int mid = runStart[(r + 1 < runs) ? r + 1 : runs];
+       int hi = runStart[(r + 2 < runs) ? r + 2 : runs];
+       int x = lo, y = mid, o = lo;
+       while (x < mid && y < hi)
+         dst[o++] = (src[y] < src[x]) ? src[y++] : src[x++];
+       while (x < mid)
+         dst[o++] = src[x++];
+       while (y < hi)
+         dst[o++] = src[y++];
+       runStart[merged++] = lo;
+     }
+     runStart[merged] = n;
+     runs = merged;
+     int * temp = src;
+     src = dst;
+     dst = temp;
+   }
+   if (src != a) {
+     for (i = 0; i < n; i++)
+       a[i] = src[i];
+   }
+   free (buf);
+   free (runStart);
+ }
+
+ /** *******************************************************************************
+  * counting sort, for keys from a small range                                     *
+  * @param  a    the array to be sorted                                            *
+  * @param  n    the size of the array                                             *
+  * @param  min  the smallest value in a                                           *
+  * @param  max  the largest value in a                                            *
+  * @post  the first n elements of a are sorted in non-descending order            *
+  *********************************************************************************/
+ void countingSort (int a [ ], int n, int min, int max) {
+   long range = (long) max - min + 1;
+   int * count = (int *) calloc (range, sizeof(int));
+   for (int i = 0; i < n; i++)
+     count[a[i] - min]++;
+   int o = 0;
+   for (long v = 0; v < range; v++) {
+     for (int c = count[v]; c > 0; c--)
+       a[o++] = (int) (v + min);
+   }
+   free (count);
+ }
+
+ /** *******************************************************************************
+  * least significant digit radix sort, four passes of 8 bits                      *
+  * @param  a  the array to be sorted                                              *
+  * @param  n  the size of the array                                               *
+  * @post  the first n elements of a are sorted in non-descending order; the sign  *
+  *        bit is flipped in the last pass so negative values come first           *
+  *********************************************************************************/
+ void radixSort (int a [ ], int n) {
+   unsigned * src = (unsigned *) a;
+   unsigned * dst = (unsigned *) malloc (n * sizeof(int));
+   unsigned * buf = dst;
+   for (int shift = 0; shift < 32; shift += 8) {
+     unsigned flip = (shift == 24) ? 0x80 : 0;
+     long count [257] = {0};
+     for (int i = 0; i < n; i++)
+       count[(((src[i] >> shift) & 0xff) ^ flip) + 1]++;
+     for (int d = 0; d < 256; d++)
+       count[d + 1] += count[d];
+     for (int i = 0; i < n; i++)
+       dst[count[((src[i] >> shift) & 0xff) ^ flip]++] = src[i];
+     unsigned * temp = src;
+     src = dst;
+     dst = temp;
+   }
+   // four passes leave the result back in a
+   free (buf);
+ }
+
+ /** *******************************************************************************
+  * hybrid quicksort with the cutoff used throughout, in the form taken by the     *
+  * tables of sort procedures                                                      *
+  *********************************************************************************/
+ void hybridQuicksortDefault (int a [ ], int n) {
+   hybridQuicksort (a, n, numaMaxSize);
+ }
+
+ /** *******************************************************************************
+  * insertion sort of a whole array, in the form taken by the tables               *
+  *********************************************************************************/
+ void insertionSortDefault (int a [ ], int n) {
+   insertionSort (a, 0, n - 1);
+ }
+
+ /** *******************************************************************************
+  * counting sort over the range the array actually holds, in the form taken by   *
+  * the tables; it needs a count for every value in the range                      *
+  *********************************************************************************/
+ void countingSortDefault (int a [ ], int n) {
+   int min = a[0];
+   int max = a[0];
+   for (int i = 1; i < n; i++) {
+     min = (a[i] < min) ? a[i] : min;
+     max = (a[i] > max) ? a[i] : max;
+   }
+   countingSort (a, n, min, max);
+ }
+
+ /** *******************************************************************************
+  * out-of-place quicksort with its own scratch array, in the form taken by the    *
+  * tables                                                                         *
+  *********************************************************************************/
+ void oopQuicksortDefault (int a [ ], int n) {
+   int * scratch = (int *) malloc (n * sizeof(int));
+   oopQuicksort (a, scratch, n);
+   free (scratch);
+ }
+
+ /** *******************************************************************************
+  * samplesort on numThreads threads, in the form taken by the tables              *
+  *********************************************************************************/
+ void samplesortDefault (int a [ ], int n) {
+   samplesort (a, n, numThreads);
+ }
+
+ /** *******************************************************************************
+  * smart sort's reversal on its own: one check and one reversal when the array    *
+  * is non-increasing, and run merge otherwise                                     *
+  *********************************************************************************/
+ void reversalSort (int a [ ], int n) {
+   if (nonIncreasing (a, n))
+     reverseSegment (a, 0, n - 1);
+   else
+     runMergeSort (a, n);
+ }
+
+ /** *******************************************************************************
+  * structure to identify both the name of a sorting algorithm and a pointer to    *
+  * the function that performs it, for the smart sort calibration table            *
+  *********************************************************************************/
+ typedef struct sorts {
+   char * name;
+   void (*proc) (int [ ], int);
+   int skip;      // data sets it is not timed on: quadraticOnFew, needsSmallRange
+ } sortType;
+
+ #define quadraticOnFew 1   // the quicksorts that take quadratic time on few distinct keys
+ #define needsSmallRange 2  // counting sort, whose counts cover the whole key range
+
+ /** *******************************************************************************
+  * adaptive sort: sample the input and hand it to the engine that suits it        *
+  * @param  a  the array to be sorted                                              *
+  * @param  n  the size of the array                                               *
+  * @post  the first n elements of a are sorted in non-descending order            *
+  * @remark  about smartSamples neighbouring pairs estimate the number of runs and  *
+  *          whether the data is descending, the same number of random pairs       *
+  *          estimate the fraction of inversions, and a sorted sample of values    *
+  *          gives a guess at the range; the thresholds come from the smart sort   *
+  *          calibration tables in the driver, where radix sort beats the          *
+  *          quicksorts above smartInsertionMax values, at every fraction of       *
+  *          duplicates, so neither duplicates nor size pick a quicksort           *
+  *********************************************************************************/
+ void smartSort (int a [ ], int n) {
+   if (n <= smartInsertionMax) {
+     insertionSort (a, 0, n - 1);
+     return;
+   }
+   int m = (n / 16 < smartSamples) ? n / 16 : smartSamples;
+
+   // runs: descents and ascents between evenly spaced neighbours
+   int descents = 0;
+   int ascents = 0;
+   for (int j = 0; j < m; j++) {
+     long i = (long) j * (n - 1) / m;
+     descents += (a[i+1] < a[i]);
+     ascents += (a[i+1] > a[i]);
+   }
+   long runs = 1 + (long) descents * (n - 1) / m;
+
+   // inversions: fraction of random pairs i < k with a[i] > a[k]
+   int inversions = 0;
+   for (int j = 0; j < m; j++) {
+     int i = rand() % n;
+     int k = rand() % n;
+     inversions += (i < k) ? (a[i] > a[k]) : (a[k] > a[i]);
+   }
+
+   // range from a sorted sample of values
+   int sample [smartSamples];
+   for (int j = 0; j < m; j++)
+     sample[j] = a[rand() % n];
+   hybridQuicksort (sample, m, numaMaxSize);
+
+   // descending with no sampled ascent: reverse if the whole array agrees
+   if (ascents == 0 && descents > 0 && nonIncreasing (a, n)) {
+     reverseSegment (a, 0, n - 1);
+     return;
+   }
+
+   // a few long runs, or nearly sorted: one run-detecting pass and merges
+   if (runs <= smartRunsMax || inversions * smartInversionDiv < m) {
+     runMergeSort (a, n);
+     return;
+   }
+
+   // small key range: counting sort
+   if ((long) sample[m-1] - sample[0] < (long) smartCountFactor * n) {
+     int min = a[0];
+     int max = a[0];
+     for (int i = 1; i < n; i++) {
+       min = (a[i] < min) ? a[i] : min;
+       max = (a[i] > max) ? a[i] : max;
+     }
+     if ((long) max - min < (long) smartCountFactor * n) {
+       countingSort (a, n, min, max);
+       return;
+     }
+   }
+
+   // scattered keys, with or without duplicates: radix sort, which beats the
+   // quicksorts from smartInsertionMax up
+   radixSort (a, n);
+ }
+
+ /* * * * * * * * incremental sorted array and helper functions * * * * * * * * * */
+
+ /** *******************************************************************************
+  * galloping search from the end of a sorted array                                *
+  * @param  a  the sorted array                                                    *
+  * @param  n  the size of the array                                               *
+  * @param  v  the value to place                                                  *
+  * @returns  the first index i with a[i] > v, or n if none; the probes step back  *
+  *           1, 2, 4, ... from the end before a binary search, so the cost grows  *
+  *           with the log of the distance from the end rather than of n           *
+  *********************************************************************************/
+ long gallopFromEnd (int a [ ], long n, int v) {
+   long hi = n;        // a[hi], ... are > v
+   long step = 1;
+   while (hi - step >= 0 && a[hi - step] > v) {
+     hi -= step;
+     step *= 2;
+   }
+   long lo = (hi - step >= 0) ? hi - step : 0;   // a[lo-1] <= v, if lo > 0
+   return upperBound (a, lo, hi, v);
+ }
+
+ /** *******************************************************************************
+  * merge a short sorted batch into a long sorted array                            *
+  * @param  a  the sorted array, with room for n + m elements                      *
+  * @param  n  the number of elements in a                                         *
+  * @param  b  the sorted batch                                                    *
+  * @param  m  the number of elements in b                                         *
+  * @post  a[0], ..., a[n+m-1] are in non-descending order                         *
+  * @remark  the merge works from the back: each batch value finds its place by    *
+  *          galloping, and the elements of a above it slide up in one block move, *
+  *          so no buffer beyond the batch is needed and the part of a below the   *
+  *          smallest batch value is never touched                                 *
+  *********************************************************************************/
+ void mergeBatch (int a [ ], long n, int b [ ], long m) {
+   long i = n;        // a[0], ..., a[i-1] are not yet in their final places
+   long o = n + m;    // a[o], ..., a[n+m-1] are final
+   for (long j = m - 1; j >= 0; j--) {
+     long pos = gallopFromEnd (a, i, b[j]);
+     long move = i - pos;
+     o -= move;
+     memmove (&a[o], &a[pos], move * sizeof(int));
+     a[--o] = b[j];
+     i = pos;
+   }
+ }
+
+ /** *******************************************************************************
+  * structure for a sorted array kept up to date as batches of values arrive       *
+  *********************************************************************************/
+ typedef struct sortedArray {
+   int * a;              // the sorted values
+   long n;               // the number of sorted values
+   long capacity;        // the room in a
+   int * pending;        // values appended but not yet merged
+   long pendingCount;
+   long pendingCapacity;
+   long lazyLimit;       // pending values are merged once there are this many
+ } sortedArrayType;
+
+ /** *******************************************************************************
+  * start a sorted array from existing values                                      *
+  * @param  s          the structure to set up                                     *
+  * @param  values     the initial values, in any order                            *
+  * @param  n          the number of initial values                                *
+  * @param  lazyLimit  pending values are merged once there are this many; 1 merges *
+  *                    every batch as it is appended                               *
+  *********************************************************************************/
+ void sortedArrayInit (sortedArrayType * s, int values [ ], long n, long lazyLimit) {
+   s->capacity = (n > 16) ? n : 16;
+   s->a = (int *) malloc (s->capacity * sizeof(int));
+   memcpy (s->a, values, n * sizeof(int));
+   hybridQuicksort (s->a, n, numaMaxSize);
+   s->n = n;
+   s->pendingCapacity = (lazyLimit > 16) ? lazyLimit : 16;
+   s->pending = (int *) malloc (s->pendingCapacity * sizeof(int));
+   s->pendingCount = 0;
+   s->lazyLimit = lazyLimit;
+ }
+
+ /** *******************************************************************************
+  * merge every pending value into the sorted array                                *
+  * @post  s->a[0], ..., s->a[s->n - 1] are sorted and nothing is pending          *
+  *********************************************************************************/
+ void sortedArrayFlush (sortedArrayType * s) {
+   long m = s->pendingCount;
+   if (m == 0)
+     return;
+   if (s->n + m > s->capacity) {
+     s->capacity = (s->n + m > 2 * s->capacity) ? s->n + m : 2 * s->capacity;
+     s->a = (int *) realloc (s->a, s->capacity * sizeof(int));
+   }
+   hybridQuicksort (s->pending, m, numaMaxSize);
+   mergeBatch (s->a, s->n, s->pending, m);
+   s->n += m;
+   s->pendingCount = 0;
+ }
+
+ /** *******************************************************************************
+  * add a batch of values to a sorted array                                        *
+  * @param  s       the sorted array                                               *
+  * @param  values  the new values, in any order                                   *
+  * @param  m       the number of new values                                       *
+  * @post  the values are pending; once lazyLimit values are pending they are      *
+  *        sorted together and merged in one pass with sortedArrayFlush            *
+  *********************************************************************************/
+ void sortedArrayAppend (sortedArrayType * s, int values [ ], long m) {
+   if (s->pendingCount + m > s->pendingCapacity) {
+     s->pendingCapacity = (s->pendingCount + m > 2 * s->pendingCapacity)
+                          ? s->pendingCount + m : 2 * s->pendingCapacity;
+     s->pending = (int *) realloc (s->pending, s->pendingCapacity * sizeof(int));
+   }
+   memcpy (&s->pending[s->pendingCount], values, m * sizeof(int));
+   s->pendingCount += m;
+   if (s->pendingCount >= s->lazyLimit)
+     sortedArrayFlush (s);
+ }
+
+ void sortedArrayFree (sortedArrayType * s) {
+   free (s->a);
+   free (s->pending);
+ }
+
+ /* * * * * * * * * * segmented sort and helper functions * * * * * * * * * * * * */
+
+ /** *******************************************************************************
+  * compare-exchange step of a sorting network, without branches                   *
+  * @post  a[i] <= a[j]                                                            *
+  *********************************************************************************/
+ void compareExchange (int a [ ], int i, int j) {
+   int small = (a[i] < a[j]) ? a[i] : a[j];
+   int large = (a[i] < a[j]) ? a[j] : a[i];
+   a[i] = small;
+   a[j] = large;
+ }
+
+ /** *******************************************************************************
+  * sort one segment, choosing the method by its length                            *
+  * @param  a   the array holding the segment                                      *
+  * @param  lo  the index of the first element of the segment                      *
+  * @param  hi  one past the index of the last element of the segment              *
+  * @post  a[lo], ..., a[hi-1] are in non-descending order: sorting networks are   *
+  *        used up to 4 elements, insertion sort up to segInsertionMax, and        *
+  *        hybrid quicksort beyond that                                            *
+  *********************************************************************************/
+ void sortSegment (int a [ ], int lo, int hi) {
+   int * s = a + lo;
+   switch (hi - lo) {
+     case 0:
+     case 1:
+       return;
+     case 2:
+       compareExchange (s, 0, 1);
+       return;
+     case 3:
+       compareExchange (s, 0, 1);
+       compareExchange (s, 1, 2);
+       compareExchange (s, 0, 1);
+       return;
+     case 4:
+       compareExchange (s, 0, 1);
+       compareExchange (s, 2, 3);
+       compareExchange (s, 0, 2);
+       compareExchange (s, 1, 3);
+       compareExchange (s, 1, 2);
+       return;
+   }
+   if (hi - lo <= segInsertionMax)
+     insertionSort (a, lo, hi - 1);
+   else
+     hybridQuicksort (s, hi - lo, numaMaxSize);
+ }
+
+ /** *******************************************************************************
+  * structure describing the segments sorted by one thread                         *
+  *********************************************************************************/
+ typedef struct segmentArgs {
+   int * a;         // the flat buffer holding all segments
+   int * offsets;   // segment k is a[offsets[k]], ..., a[offsets[k+1]-1]
+   int first;       // the first segment sorted by this thread
+   int last;        // one past the last segment sorted by this thread
+ } segmentType;
+
+ void * segmentThread (void * arg) {
+   segmentType * t = (segmentType *) arg;
+   for (int k = t->first; k < t->last; k++)
+     sortSegment (t->a, t->offsets[k], t->offsets[k+1]);
+   return NULL;
+ }
+
+ /** *******************************************************************************
+  * segmented sort, sorting many independent segments of one buffer in one call    *
+  * @param  a         the flat buffer holding the segments back to back            *
+  * @param  offsets   segment k is a[offsets[k]], ..., a[offsets[k+1]-1], so       *
+  *                   offsets has segments+1 entries                               *
+  * @param  segments  the number of segments                                       *
+  * @param  threads   the number of threads to spread the segments over            *
+  * @post  every segment is sorted in non-descending order; elements never move    *
+  *        from one segment to another                                             *
+  * @remark  each thread gets a run of consecutive segments, cut so every thread   *
+  *          has about the same number of elements plus one per segment to cover   *
+  *          the fixed cost of each segment                                        *
+  *********************************************************************************/
+ void segmentedSort (int a [ ], int offsets [ ], int segments, int threads) {
+   pthread_t thread [threads];
+   segmentType args [threads];
+   long total = (long) offsets[segments] - offsets[0] + segments;
+
+   int k = 0;
+   long weight = 0;
+   for (int t = 0; t < threads; t++) {
+     long target = total * (t + 1) / threads;
+     args[t].a = a;
+     args[t].offsets = offsets;
+     args[t].first = k;
+     while (k < segments && weight < target) {
+       weight += offsets[k+1] - offsets[k] + 1;
+       k++;
+     }
+     args[t].last = k;
+     pthread_create (&thread[t], NULL, segmentThread, &args[t]);
+   }
+   for (int t = 0; t < threads; t++)
+     pthread_join (thread[t], NULL);
+ }
+
+ /** *******************************************************************************
+  * build segment offsets with a skewed length distribution, like per-group lists: *
+  * most segments hold a handful of elements and a few hold thousands              *
+  * @param  offsets  receives the offsets, with room for n+1 entries               *
+  * @param  n        the total number of elements to cover                         *
+  * @returns  the number of segments                                               *
+  *********************************************************************************/
+ int makeSegmentOffsets (int offsets [ ], int n) {
+   int segments = 0;
+   offsets[0] = 0;
+   while (offsets[segments] < n) {
+     // the smaller of two uniform exponents favors short segments
+     int e1 = rand() % 12;
+     int e2 = rand() % 12;
+     int e = (e1 < e2) ? e1 : e2;
+     int len = (1 << e) + rand() % (1 << e);
+     if (len > n - offsets[segments])
+       len = n - offsets[segments];
+     offsets[segments + 1] = offsets[segments] + len;
+     segments++;
+   }
+   return segments;
+ }
+
+ /** *******************************************************************************
+  * build segment offsets for many tiny segments, like the rows of a sparse       *
+  * matrix or short per-key lists: lengths uniform from 1 to segInsertionMax, so   *
+  * every segment takes the network or insertion sort path                        *
+  * @param  offsets  receives the offsets, with room for n+1 entries               *
+  * @param  n        the total number of elements to cover                         *
+  * @returns  the number of segments                                               *
+  *********************************************************************************/
+ int makeTinySegmentOffsets (int offsets [ ], int n) {
+   int segments = 0;
+   offsets[0] = 0;
+   while (offsets[segments] < n) {
+     int len = 1 + rand() % segInsertionMax;
+     if (len > n - offsets[segments])
+       len = n - offsets[segments];
+     offsets[segments + 1] = offsets[segments] + len;
+     segments++;
+   }
+   return segments;
+ }
+
+ /* * * * * * * * * * sort-based group-by and helper functions * * * * * * * * * * */
+
+ /** *******************************************************************************
+  * output of a group-by: distinct keys in ascending order, and how often each    *
+  * occurs                                                                         *
+  *********************************************************************************/
+ typedef struct groups {
+   int * keys;
+   int * counts;      // NULL when only the distinct keys are wanted
+   long groups;       // entries written so far
+ } groupType;
+
+ /** *******************************************************************************
+  * append a group to the output                                                   *
+  *********************************************************************************/
+ void emitGroup (groupType * g, int key, int count) {
+   g->keys[g->groups] = key;
+   if (g->counts != NULL)
+     g->counts[g->groups] = count;
+   g->groups++;
+ }
+
+ /** *******************************************************************************
+  * record a finished group at the position of its first element: the key in     *
+  * keys, the count in the array itself, whose copies of the key are not needed   *
+  * any more                                                                       *
+  *********************************************************************************/
+ void placeGroup (int a [ ], int keys [ ], int at, int key, int count) {
+   keys[at] = key;
+   a[at] = count;
+ }
+
+ /** *******************************************************************************
+  * group-by helper: quicksort with a three-way partition that stops at the keys  *
+  * it can already count                                                           *
+  * @param  a      the array, used as workspace                                   *
+  * @param  left   the lower index for items to be processed                       *
+  * @param  right  the upper index for items to be processed                       *
+  * @param  keys   room for n keys, indexed like a                                 *
+  * @param  seed   state for rand_r, so threads grouping slices share no lock      *
+  * @post  each group of a[left..right] is placed at the index its first element  *
+  *        has once sorted, so groupCount can collect them in ascending order      *
+  * @remark  every element equal to the pivot ends in the middle block, which is   *
+  *          a finished group and is never touched again, so duplicates cost one   *
+  *          pass instead of a sort; short ranges are insertion sorted while they   *
+  *          are in cache and their runs placed straight away; since groups go by  *
+  *          position rather than in the order they are found, the smaller side    *
+  *          is the one recursed into and the stack stays O(log n) deep            *
+  *********************************************************************************/
+ void groupHelper (int a [ ], int left, int right, int keys [ ], unsigned * seed) {
+   while (right - left + 1 > groupLeafSize) {
+     int p = left + rand_r (seed) % (right - left + 1);
+     int pivot = a[p];
+     a[p] = a[left];
+     a[left] = pivot;
+     // a branch-free Lomuto pass over the rest: values < pivot to the front,
+     // every element swapped with the first of the larger block, which only
+     // grows on a match; copies of the pivot are counted on the way
+     int lt = left + 1;
+     int copies = 0;
+     for (int i = left + 1; i <= right; i++) {
+       int v = a[i];
+       a[i] = a[lt];
+       a[lt] = v;
+       lt += (v < pivot);
+       copies += (v == pivot);
+     }
+     lt--;
+     a[left] = a[lt];
+     a[lt] = pivot;
+     // only when there are copies, a second pass gathers them after the pivot,
+     // stopping once the last is found; then a[lt..gt] == pivot
+     int gt = lt;
+     for (int i = lt + 1; i <= right && gt - lt < copies; i++) {
+       int v = a[i];
+       a[i] = a[gt + 1];
+       a[gt + 1] = v;
+       gt += (v == pivot);
+     }
+     placeGroup (a, keys, lt, pivot, gt - lt + 1);
+     if (lt - left < right - gt) {
+       groupHelper (a, left, lt - 1, keys, seed);
+       left = gt + 1;
+     }
+     else {
+       groupHelper (a, gt + 1, right, keys, seed);
+       right = lt - 1;
+     }
+   }
+   if (left > right)
+     return;
+   insertionSort (a, left, right);
+   int start = left;
+   int key = a[left];
+   for (int i = left + 1; i <= right + 1; i++) {
+     if (i > right || a[i] != key) {
+       placeGroup (a, keys, start, key, i - start);
+       start = i;
+       if (i <= right)
+         key = a[i];
+     }
+   }
+ }
+
+ /** *******************************************************************************
+  * group-by count with the caller's random state, for the threads of             *
+  * parallelGroupCount                                                             *
+  * @param  seed  state for rand_r                                                 *
+  * @remark  other parameters and result as in groupCount; groupHelper leaves each *
+  *          group at the index of its first element, and the count there leads to *
+  *          the next, so collecting them touches only the groups                  *
+  *********************************************************************************/
+ long seededGroupCount (int a [ ], int n, int keys [ ], int counts [ ], unsigned * seed) {
+   groupHelper (a, 0, n - 1, keys, seed);
+   long groups = 0;
+   for (int at = 0; at < n; at += a[at]) {
+     keys[groups] = keys[at];           // groups <= at, so nothing unread is lost
+     if (counts != NULL)
+       counts[groups] = a[at];
+     groups++;
+   }
+   return groups;
+ }
+
+ /** *******************************************************************************
+  * group-by count, fused into sorting                                             *
+  * @param  a       the values; the array is used as workspace and its contents    *
+  *                 are lost                                                       *
+  * @param  n       the number of values                                           *
+  * @param  keys    room for n keys                                                *
+  * @param  counts  room for up to n counts, or NULL for the distinct keys alone   *
+  * @post  keys[0], ..., keys[groups-1] are the distinct values in ascending order *
+  *        and counts[j] is the number of times keys[j] occurs                     *
+  * @returns  groups, the number of distinct values                                *
+  *********************************************************************************/
+ long groupCount (int a [ ], int n, int keys [ ], int counts [ ]) {
+   unsigned seed = rand ();
+   return seededGroupCount (a, n, keys, counts, &seed);
+ }
+
+ /** *******************************************************************************
+  * the second pass groupCount saves: collapse a sorted array into its groups      *
+  * @param  a  the sorted values                                                   *
+  * @remark  other parameters and result as in groupCount                          *
+  *********************************************************************************/
+ long scanGroups (int a [ ], int n, int keys [ ], int counts [ ]) {
+   groupType g = { keys, counts, 0 };
+   int start = 0;
+   for (int i = 1; i <= n; i++) {
+     if (i == n || a[i] != a[start]) {
+       emitGroup (&g, a[start], i - start);
+       start = i;
+     }
+   }
+   return g.groups;
+ }
+
+ /** *******************************************************************************
+  * one thread of the parallel group-by: first its slice of the input, then its    *
+  * range of keys from every thread's groups                                       *
+  *********************************************************************************/
+ typedef struct groupArgs {
+   int * a;                      // slice of the input
+   int n;
+   int * keys;                   // groups of the slice
+   int * counts;
+   long groups;
+   unsigned seed;                // for rand_r, since rand is shared by all threads
+   struct groupArgs * all;       // every thread's arguments
+   int threads;
+   int hasLow, hasHigh;          // whether the key range below has an end
+   int low, high;                // keys low <= key < high are merged here
+   int * outKeys;                // merged groups of the key range
+   int * outCounts;
+   long outGroups;
+ } groupArgsType;
+
+ void * groupSliceThread (void * arg) {
+   groupArgsType * t = (groupArgsType *) arg;
+   t->groups = seededGroupCount (t->a, t->n, t->keys, t->counts, &t->seed);
+   return NULL;
+ }
+
+ void * groupMergeThread (void * arg) {
+   groupArgsType * t = (groupArgsType *) arg;
+   int threads = t->threads;
+   long from [threads];
+   long to [threads];
+   long total = 0;
+   for (int k = 0; k < threads; k++) {
+     groupArgsType * s = &t->all[k];
+     from[k] = t->hasLow ? lowerBound (s->keys, 0, s->groups, t->low) : 0;
+     to[k] = t->hasHigh ? lowerBound (s->keys, 0, s->groups, t->high) : s->groups;
+     total += to[k] - from[k];
+   }
+   t->outKeys = (int *) malloc ((total > 0 ? total : 1) * sizeof(int));
+   t->outCounts = (t->all[0].counts == NULL) ? NULL
+                  : (int *) malloc ((total > 0 ? total : 1) * sizeof(int));
+   t->outGroups = 0;
+
+   // merge the sorted group lists, adding counts of keys found in several
+   while (1) {
+     int best = -1;
+     for (int k = 0; k < threads; k++) {
+       if (from[k] < to[k] && (best < 0 || t->all[k].keys[from[k]] < t->all[best].keys[from[best]]))
+         best = k;
+     }
+     if (best < 0)
+       break;
+     int key = t->all[best].keys[from[best]];
+     int count = 0;
+     for (int k = 0; k < threads; k++) {
+       if (from[k] < to[k] && t->all[k].keys[from[k]] == key) {
+         if (t->outCounts != NULL)
+           count += t->all[k].counts[from[k]];
+         from[k]++;
+       }
+     }
+     t->outKeys[t->outGroups] = key;
+     if (t->outCounts != NULL)
+       t->outCounts[t->outGroups] = count;
+     t->outGroups++;
+   }
+   return NULL;
+ }
+
+ /** *******************************************************************************
+  * parallel group-by count: each thread groups a slice, then the threads merge    *
+  * the per-slice groups, each taking a range of keys bounded by splitters         *
+  * sampled from the slices                                                        *
+  * @param  threads  the number of threads                                         *
+  * @remark  other parameters and result as in groupCount                          *
+  *********************************************************************************/
+ long parallelGroupCount (int a [ ], int n, int keys [ ], int counts [ ], int threads) {
+   pthread_t ids [threads];
+   groupArgsType args [threads];
+   for (int k = 0; k < threads; k++) {
+     long lo = (long) n * k / threads;
+     long hi = (long) n * (k + 1) / threads;
+     args[k].a = a + lo;
+     args[k].n = (int) (hi - lo);
+     args[k].keys = (int *) malloc ((hi - lo + 1) * sizeof(int));
+     args[k].counts = (counts == NULL) ? NULL : (int *) malloc ((hi - lo + 1) * sizeof(int));
+     args[k].seed = rand ();
+     args[k].all = args;
+     args[k].threads = threads;
+     pthread_create (&ids[k], NULL, groupSliceThread, &args[k]);
+   }
+   for (int k = 0; k < threads; k++)
+     pthread_join (ids[k], NULL);
+
+   // splitters: evenly spaced keys of every slice, sorted, evenly spaced again
+   int samples [threads * threads];
+   int s = 0;
+   for (int k = 0; k < threads; k++) {
+     for (int j = 0; j < threads && args[k].groups > 0; j++)
+       samples[s++] = args[k].keys[args[k].groups * j / threads];
+   }
+   insertionSort (samples, 0, s - 1);
+   for (int k = 0; k < threads; k++) {
+     args[k].hasLow = (k > 0 && s > 0);
+     args[k].hasHigh = (k < threads - 1 && s > 0);
+     if (args[k].hasLow)
+       args[k].low = samples[(long) s * k / threads];
+     if (args[k].hasHigh)
+       args[k].high = samples[(long) s * (k + 1) / threads];
+     pthread_create (&ids[k], NULL, groupMergeThread, &args[k]);
+   }
+   for (int k = 0; k < threads; k++)
+     pthread_join (ids[k], NULL);
+
+   long groups = 0;
+   for (int k = 0; k < threads; k++) {
+     memcpy (keys + groups, args[k].outKeys, args[k].outGroups * sizeof(int));
+     if (counts != NULL)
+       memcpy (counts + groups, args[k].outCounts, args[k].outGroups * sizeof(int));
+     groups += args[k].outGroups;
+     free (args[k].keys);
+     free (args[k].counts);
+     free (args[k].outKeys);
+     free (args[k].outCounts);
+   }
+   return groups;
+ }
+
+ /** *******************************************************************************
+  * fill an array with Zipf-distributed keys: rank r turns up in proportion to    *
+  * 1 / r^zipfExponent, among zipfKeys ranks scattered over the int range          *
+  * @param  a  the array                                                           *
+  * @param  n  the size of the array                                               *
+  *********************************************************************************/
+ void zipfFill (int a [ ], int n) {
+   double * cdf = (double *) malloc (zipfKeys * sizeof(double));
+   double total = 0;
+   for (int r = 0; r < zipfKeys; r++) {
+     total += 1.0 / pow (r + 1, zipfExponent);
+     cdf[r] = total;
+   }
+   for (int i = 0; i < n; i++) {
+     double u = (rand() / ((double) RAND_MAX + 1)) * total;
+     int lo = 0;
+     int hi = zipfKeys - 1;
+     while (lo < hi) {
+       int mid = (lo + hi) / 2;
+       if (cdf[mid] <= u)
+         lo = mid + 1;
+       else
+         hi = mid;
+     }
+     a[i] = (int) ((unsigned) lo * 2654435761u);   // distinct ranks stay distinct
+   }
+   free (cdf);
+ }
+
+ /* * * * * * * * * * partition profiler for the quicksorts * * * * * * * * * * * */
+
+ /** *******************************************************************************
+  * one node of the recursion tree as the profiler keeps it: the ranges at one    *
+  * depth reached through the same chain of size classes share a node, so the     *
+  * tree stays small while still showing where the time goes                      *
+  *********************************************************************************/
+ typedef struct profileNode {
+   int parent;             // index of the parent node, -1 for the root
+   int sizeClass;          // floor (log2 (range size)) of the ranges in the node
+   int firstChild;         // children as a linked list, -1 if none
+   int nextSibling;
+   long partitionTime;     // nanoseconds partitioning the ranges themselves
+   long subtreeTime;       // nanoseconds in subtrees below profileTimeMin
+   long insertionTime;     // nanoseconds insertion sorting, hybrid quicksort only
+ } profileNodeType;
+
+ /** *******************************************************************************
+  * profile of one or more quicksort runs                                          *
+  *********************************************************************************/
+ typedef struct profile {
+   char * name;                                  // root frame of the folded stacks
+   long sizeCount [profileClasses];              // partitions by floor (log2 (size))
+   long ratioCount [profileRatios];              // partitions by (mid-left)/(right-left)
+   long depthCount [profileDepthMax];            // partitions at each depth
+   long depthRange [profileDepthMax];            // their total range size
+   long depthPartitionTime [profileDepthMax];    // nanoseconds, as in profileNode
+   long depthSubtreeTime [profileDepthMax];
+   long depthInsertionTime [profileDepthMax];
+   int maxDepth;
+   profileNodeType * nodes;
+   int nodeCount;
+   int depth;                // where the sort being profiled is: depth of the
+   int node;                 // current call and its node, -1 inside an untimed subtree
+   long start;               // when the current partition or insertion sort began
+   int subtreeNode;          // node and start time of the small subtree being timed
+   long subtreeStart;
+ } profileType;
+
+ /** *******************************************************************************
+  * start an empty profile                                                         *
+  * @param  p     the profile                                                      *
+  * @param  name  root frame of the folded stacks, usually the sort's name         *
+  *********************************************************************************/
+ void profileInit (profileType * p, char * name) {
+   memset (p, 0, sizeof(profileType));
+   p->name = name;
+   p->nodes = (profileNodeType *) malloc (profileNodesMax * sizeof(profileNodeType));
+   p->nodes[0] = (profileNodeType) {-1, 0, -1, -1, 0, 0, 0};
+   p->nodeCount = 1;
+ }
+
+ /** *******************************************************************************
+  * free the tree of a profile                                                     *
+  *********************************************************************************/
+ void profileFree (profileType * p) {
+   free (p->nodes);
+   p->nodes = NULL;
+ }
+
+ /** *******************************************************************************
+  * monotonic clock in nanoseconds, read only for ranges of profileTimeMin values  *
+  * or more, so the profiler reads it a few times per profileTimeMin values sorted *
+  *********************************************************************************/
+ long profileTicks ( ) {
+   struct timespec now;
+   clock_gettime (CLOCK_MONOTONIC, &now);
+   return now.tv_sec * 1000000000L + now.tv_nsec;
+ }
+
+ /** *******************************************************************************
+  * floor (log2 (n)) for n >= 1                                                    *
+  *********************************************************************************/
+ int profileClass (long n) {
+   return 63 - __builtin_clzl (n);
+ }
+
+ /** *******************************************************************************
+  * child of a node for ranges of one size class, made if it does not exist       *
+  * @returns  the child, or the node itself once the tree has profileNodesMax nodes *
+  *********************************************************************************/
+ int profileChild (profileType * p, int node, int sizeClass) {
+   int c;
+   for (c = p->nodes[node].firstChild; c >= 0; c = p->nodes[c].nextSibling) {
+     if (p->nodes[c].sizeClass == sizeClass)
+       return c;
+   }
+   if (p->nodeCount == profileNodesMax)
+     return node;
+   c = p->nodeCount++;
+   p->nodes[c] = (profileNodeType) {node, sizeClass, -1, p->nodes[node].firstChild, 0, 0, 0};
+   p->nodes[node].firstChild = c;
+   return c;
+ }
+
+ /** *******************************************************************************
+  * a recursion depth as an index of the per-depth tables                          *
+  *********************************************************************************/
+ int profileDepth (int depth) {
+   return (depth < profileDepthMax) ? depth : profileDepthMax - 1;
+ }
+
+ /** *******************************************************************************
+  * count one partition call in the histograms                                     *
+  * @param  p      the profile                                                     *
+  * @param  depth  depth of the call, 0 for the whole array                        *
+  * @param  left   first index of the range                                        *
+  * @param  right  last index of the range                                         *
+  * @param  mid    index the pivot ended at                                        *
+  *********************************************************************************/
+ void profileRecord (profileType * p, int depth, int left, int right, int mid) {
+   long range = right - left + 1;
+   int d = profileDepth (depth);
+   p->sizeCount[profileClass (range)]++;
+   if (range > 1) {
+     int r = (int) ((long) (mid - left) * profileRatios / (right - left));
+     p->ratioCount[(r < profileRatios) ? r : profileRatios - 1]++;
+   }
+   p->depthCount[d]++;
+   p->depthRange[d] += range;
+   p->maxDepth = (depth > p->maxDepth) ? depth : p->maxDepth;
+ }
+
+ /** *******************************************************************************
+  * hook: a timed call on a range smaller than profileTimeMin times its whole      *
+  * subtree at once, and only counts the partitions inside it                      *
+  * @returns  1 if the caller should sort the range as an untimed subtree and then *
+  *           call profileLeaveSubtree, 0 if it should partition it as usual       *
+  *********************************************************************************/
+ int profileEnterSubtree (profileType * p, int left, int right) {
+   if (p->node < 0 || right - left + 1 >= profileTimeMin)
+     return 0;
+   p->subtreeNode = p->node;
+   p->node = -1;
+   p->subtreeStart = profileTicks ();
+   return 1;
+ }
+
+ /** *******************************************************************************
+  * hook: charge the small subtree just sorted to the node that started it        *
+  *********************************************************************************/
+ void profileLeaveSubtree (profileType * p) {
+   long elapsed = profileTicks () - p->subtreeStart;
+   p->node = p->subtreeNode;
+   p->nodes[p->node].subtreeTime += elapsed;
+   p->depthSubtreeTime[profileDepth (p->depth)] += elapsed;
+ }
+
+ /** *******************************************************************************
+  * hook: a partition is about to start                                            *
+  *********************************************************************************/
+ void profileBeforePartition (profileType * p) {
+   p->start = (p->node >= 0) ? profileTicks () : 0;
+ }
+
+ /** *******************************************************************************
+  * hook: count the partition just done, time it if the call is timed, and move   *
+  * the profile down to the calls on its two sides                                 *
+  * @returns  the node to give back to profileLeave once both sides are sorted     *
+  *********************************************************************************/
+ int profileAfterPartition (profileType * p, int left, int right, int mid) {
+   int node = p->node;
+   int child = -1;
+   profileRecord (p, p->depth, left, right, mid);
+   if (node >= 0) {
+     long now = profileTicks ();
+     int d = profileDepth (p->depth);
+     child = profileChild (p, node, profileClass (right - left + 1));
+     p->nodes[child].partitionTime += now - p->start;
+     p->depthPartitionTime[d] += now - p->start;
+     p->start = now;
+   }
+   p->node = child;
+   p->depth++;
+   return node;
+ }
+
+ /** *******************************************************************************
+  * hook: charge the insertion sorts just done after a partition to its node      *
+  *********************************************************************************/
+ void profileAfterInsertion (profileType * p) {
+   if (p->node < 0)
+     return;
+   long elapsed = profileTicks () - p->start;
+   p->nodes[p->node].insertionTime += elapsed;
+   p->depthInsertionTime[profileDepth (p->depth - 1)] += elapsed;
+ }
+
+ /** *******************************************************************************
+  * hook: both sides of a partition are sorted; move the profile back up          *
+  *********************************************************************************/
+ void profileLeave (profileType * p, int node) {
+   p->node = node;
+   p->depth--;
  }
- 
+
  /** *******************************************************************************
-  * quicksort, main function                                                       *
+  * improved quicksort, profiled: imprQuicksortHelper given the profile, so the   *
+  * partitions and the random pivots are exactly those of imprQuicksort            *
   * @param  a  the array to be sorted                                              *
   * @param  n  the size of the array                                               *
-  * @post  the first n elements of a are sorted in non-descending order            *
-   ********************************************************************************/
- void imprQuicksort (int a [ ], int n) {
-   imprQuicksortHelper (a, n, 0, n-1);
+  * @param  p  the profile, which this run adds to                                 *
+  * @post  the first n elements of a are sorted exactly as imprQuicksort sorts     *
+  *        them                                                                    *
+  *********************************************************************************/
+ void profiledImprQuicksort (int a [ ], int n, profileType * p) {
+   p->depth = 0;
+   p->node = 0;
+   imprQuicksortHelper (a, n, 0, n-1, p);
  }
 
-  /* * * * * * * * hybrid quicksort and helper functions * * * * * * * * * * */
- 
  /** *******************************************************************************
-  * procedure implements the partition operation, following Loop Invariant 1a      *
-  *    the Reading on Quicksort referenced above                                   *
-  *    in brief: array segment has pivot, then small, unprocessed, large elements  *
-  *              both unprocessed endpoints examined, swapping done in line        *
-  * @param   a      the array containing the segment to be partitioned             *
-  * @param   size   the size of array a                                            *
-  * @param   left   the index of the first array element in the partition          *
-  * @param   right  the index of the last array element in the partitionn          *
-  * @post    a[left] is moved to index mid, with left <= mid <= right              *
-  * @post    elements between left and right are permuted, so that                 *
-  *             a[left], ..., a[mid-1] <= a[mid]                                   *
-  *             a[mid+1], ..., a[right] >= a[mid]                                  *
-  * @post    elements outside left, ..., right are not changed                     *
-  * @returns  mid                                                                  *
- / *********************************************************************************/
- int hybridPartition (int a[ ], int size, int left, int right) {
-
-  int temp;
-  int randIndex = left + (rand() % (right - left + 1));
-  temp = a[randIndex];
-  a[randIndex] = a[left];
-  a[left] = temp;
-
-  int pivot = a[left];
-  int l_spot = left+1;
-  int r_spot = right;
-  
-  while (l_spot <= r_spot) {
-    while( (l_spot <= r_spot) && (a[r_spot] >= pivot))
-      r_spot--;
-    while ((l_spot <= r_spot) && (a[l_spot] <= pivot)) 
-      l_spot++;
-
-    // if misplaced small and large values found, swap them
-    if (l_spot < r_spot) {
-      temp = a[l_spot];
-      a[l_spot] = a[r_spot];
-      a[r_spot] = temp;
-      l_spot++;
-      r_spot--;
-      }
-  }
-
- //  swap a[left] with biggest small value
-  temp = a[left];
-  a[left] = a[r_spot];
-  a[r_spot] = temp;
-  return r_spot;
-}
+  * hybrid quicksort, profiled: hybridQuicksortHelper given the profile, which    *
+  * also times the insertion sorts of timed ranges                                 *
+  * @param  a        the array to be sorted                                        *
+  * @param  n        the size of the array                                         *
+  * @param  maxSize  insertion sort cutoff, as in hybridQuicksort                  *
+  * @param  p        the profile, which this run adds to                           *
+  * @post  the first n elements of a are sorted exactly as hybridQuicksort sorts   *
+  *        them                                                                    *
+  *********************************************************************************/
+ void profiledHybridQuicksort (int a [ ], int n, int maxSize, profileType * p) {
+   p->depth = 0;
+   p->node = 0;
+   hybridQuicksortHelper (a, n, 0, n-1, maxSize, p);
+ }
 
-/** *******************************************************************************
- * Quicksort helper function                                                      *
- * @param  a  the array to be processed                                           *
- * @param  size  the size of the array                                            *
- * @param  left  the lower index for items to be processed                        *
- * @param  right the upper index for items to be processed                        *
- * @post  sorts elements of a between left and right                              *
- *********************************************************************************/
-void hybridQuicksortHelper (int a [ ], int size, int left, int right, const int maxSize) {
-  if (left > right)
-    return;
-  int mid = imprPartition (a, size, left, right);
-  if (mid - left < maxSize){
-    insertionSort(a, left, mid - 1);
-    insertionSort(a, mid + 1, right);
-  }
-  else{
-    hybridQuicksortHelper (a, size, left, mid-1, maxSize);
-    hybridQuicksortHelper (a, size, mid+1, right, maxSize);
-  }
-}
+ /** *******************************************************************************
+  * print the histograms and the time spent at each depth; depths are grouped     *
+  * 0, 1, 2-3, 4-7, ..., and times are in milliseconds                            *
+  *********************************************************************************/
+ void profilePrint (profileType * p) {
+   long partitions = 0;
+   for (int c = 0; c < profileClasses; c++)
+     partitions += p->sizeCount[c];
+   printf ("%s: %ld partitions, deepest recursion %d\n", p->name, partitions, p->maxDepth);
 
-/** *******************************************************************************
- * quicksort, main function                                                       *
- * @param  a  the array to be sorted                                              *
- * @param  n  the size of the array                                               *
- * @post  the first n elements of a are sorted in non-descending order            *
-  ********************************************************************************/
-void hybridQuicksort (int a [ ], int n, int maxSize) {
-  hybridQuicksortHelper (a, n, 0, n-1, maxSize);
-}
+   printf ("  range size    ");
+   for (int c = 0; c < profileClasses; c += 2)
+     printf (" 2^%-5d", c);
+   printf ("\n  partitions    ");
+   for (int c = 0; c < profileClasses; c += 2)
+     printf (" %7ld", p->sizeCount[c] + p->sizeCount[c+1]);
 
-void insertionSort(int arr[], int left, int right) {
+   printf ("\n  split ratio   ");
+   for (int r = 0; r < profileRatios; r++)
+     printf ("  %.1lf+  ", r / (double) profileRatios);
+   printf ("\n  partitions    ");
+   for (int r = 0; r < profileRatios; r++)
+     printf (" %7ld", p->ratioCount[r]);
 
-  // Starting from the second element
-  for (int i = left; i <= right; i++) {
-      int key = arr[i];
-      int j = i - 1;
+   printf ("\n     Depth  Partitions  Mean Range  Partition ms  Small Subtree ms  Insertion ms\n");
+   for (int lo = 0; lo < profileDepthMax && lo <= p->maxDepth; lo = (lo == 0) ? 1 : 2 * lo) {
+     int hi = (lo == 0) ? 1 : 2 * lo;
+     long count = 0, range = 0, partitionTime = 0, subtreeTime = 0, insertionTime = 0;
+     for (int d = lo; d < hi && d < profileDepthMax; d++) {
+       count += p->depthCount[d];
+       range += p->depthRange[d];
+       partitionTime += p->depthPartitionTime[d];
+       subtreeTime += p->depthSubtreeTime[d];
+       insertionTime += p->depthInsertionTime[d];
+     }
+     printf ("%5d-%-4d %11ld %11.0lf %13.1lf %17.1lf %13.1lf\n", lo, hi - 1, count,
+             (count > 0) ? range / (double) count : 0.0,
+             partitionTime / 1e6, subtreeTime / 1e6, insertionTime / 1e6);
+   }
+ }
 
-      // Move elements of arr[0..i-1], that are
-        // greater than key, to one position to
-        // the right of their current position
-      while (j >= 0 && arr[j] > key) {
-          arr[j + 1] = arr[j];
-          j = j - 1;
-      }
+ /** *******************************************************************************
+  * write the profile as folded stacks, one line per frame path and kind of work, *
+  * with nanoseconds as the sample count, for flamegraph.pl and similar tools      *
+  * @param  p     the profile                                                      *
+  * @param  path  the file to write                                               *
+  * @returns  0, or -1 if the file could not be written                            *
+  *********************************************************************************/
+ int profileWriteFolded (profileType * p, const char * path) {
+   FILE * out = fopen (path, "w");
+   if (out == NULL)
+     return -1;
+   int chain [profileDepthMax];
+   for (int node = 0; node < p->nodeCount; node++) {
+     int depth = 0;
+     for (int c = node; c > 0 && depth < profileDepthMax; c = p->nodes[c].parent)
+       chain[depth++] = c;
+     char * kinds [3] = {"partition", "small subtrees", "insertionSort"};
+     long times [3] = {p->nodes[node].partitionTime, p->nodes[node].subtreeTime,
+                       p->nodes[node].insertionTime};
+     for (int k = 0; k < 3; k++) {
+       if (times[k] == 0)
+         continue;
+       fprintf (out, "%s", p->name);
+       for (int j = depth - 1; j >= 0; j--)
+         fprintf (out, ";2^%d", p->nodes[chain[j]].sizeClass);
+       fprintf (out, ";%s %ld\n", kinds[k], times[k]);
+     }
+   }
+   return (fclose (out) == 0) ? 0 : -1;
+ }
 
-      // Move the key to its correct position
-      arr[j + 1] = key;
-  }
-}
- 
  /* * * * * * * * * * * * procedures to check sorting correctness  * * * * * * * * * */
  
  /** *******************************************************************************
@@ -272,11 +2478,10 @@ void insertionSort(int arr[], int left, int right) {
   *********************************************************************************/
  
  char * checkAscValues (int a [ ], int n) {
-   for (int i = 0; i < n; i++) {
-     if (a[i] != 2*i) {
-       printf ("%4d %4d", i, a[i]);
-       return "NO";
-     }
+   long i = verifyAscValues (a, n, verifyThreads);
+   if (i >= 0) {
+     printf ("%4ld %4d", i, a[i]);
+     return "NO";
    }
    return "ok";
  }
@@ -289,17 +2494,79 @@ void insertionSort(int arr[], int left, int right) {
   *********************************************************************************/
  
  char * checkAscending (int a [ ], int n) {
+   return (verifyAscending (a, n, verifyThreads) < 0) ? "ok" : "NO";
+ }
+
+ /** *******************************************************************************
+  * check a sorted array still holds the values it started with                    *
+  * @param  a       the array that was sorted                                      *
+  * @param  n       the size of the array                                          *
+  * @param  before  fingerprintArray of the array before it was sorted             *
+  * returns  "ok" if array elements are in non-descending order and have the same  *
+  *          fingerprint; "NO" if out of order; "NP" if values were lost or added  *
+  *********************************************************************************/
+
+ char * checkSortedPermutation (int a [ ], int n, fingerprintType before) {
+   if (verifyAscending (a, n, verifyThreads) >= 0)
+     return "NO";
+   return fingerprintEqual (fingerprintArray (a, n, verifyThreads), before) ? "ok" : "NP";
+ }
+
+ /** *******************************************************************************
+  * check every segment is in non-descending order                                 *
+  * @param  a         the flat buffer holding the segments                         *
+  * @param  offsets   segment k is a[offsets[k]], ..., a[offsets[k+1]-1]           *
+  * @param  segments  the number of segments                                       *
+  * returns  "ok" if each segment is in non-descending order; "NO" otherwise       *
+  *********************************************************************************/
+
+ char * checkSegments (int a [ ], int offsets [ ], int segments) {
+   for (int k = 0; k < segments; k++) {
+     if (checkAscending (a + offsets[k], offsets[k+1] - offsets[k])[0] == 'N')
+       return "NO";
+   }
+   return "ok";
+ }
+
+ /** *******************************************************************************
+  * check records with equal keys are still in their original order                *
+  * @param  r  the records, sorted by key, whose payloads were their original      *
+  *            positions                                                           *
+  * @param  n  the number of records                                               *
+  * returns  "ok" if keys are non-descending and equal keys have increasing        *
+  *          payloads; "NO" otherwise                                              *
+  *********************************************************************************/
+
+ char * checkStable (recordType r [ ], int n) {
    for (int i = 0; i < n-1; i++) {
-     if (a[i] > a[i+1])
+     if (r[i].key > r[i+1].key)
+       return "NO";
+     if (r[i].key == r[i+1].key && r[i].payload > r[i+1].payload)
        return "NO";
    }
    return "ok";
  }
+
+ /** *******************************************************************************
+  * copy the keys of records into an array of int, for the checks above            *
+  *********************************************************************************/
+
+ void recordKeys (recordType r [ ], int n, int keys [ ]) {
+   for (int i = 0; i < n; i++)
+     keys[i] = r[i].key;
+ }
  
  /** *******************************************************************************
   * driver program for testing and timing quicksort algorithms                     *
+  * programs that #include this file for its sorts define omitDriver first         *
    ********************************************************************************/
+ #ifndef omitDriver
  int main ( ) {
+   // NUMA layout used by the NUMA-aware quicksort
+   int nodes = numaNodeCount ();
+   printf ("NUMA nodes: %d (%s), threads per node: %d\n", nodes,
+           (simulatedNodes > 0) ? "simulated" : "detected", threadsPerNode);
+
    // print headings
    printf ("                    Data Set                   Times\n");
    printf ("Algorithm             Size     Ascending Order   Random Order  Descending Order\n");
@@ -317,6 +2584,8 @@ void insertionSort(int arr[], int left, int right) {
          ran[i] = rand();
          des[i] = 2*(size - i - 1); 
       } 
+      // fingerprint of the random data, to catch a sort that loses values
+      fingerprintType ranPrint = fingerprintArray (ran, size, verifyThreads);
  
       // timing variables
       clock_t start_time, end_time;
@@ -358,7 +2627,7 @@ void insertionSort(int arr[], int left, int right) {
       end_time = clock();
       elapsed_time = (end_time - start_time) / (double) CLOCKS_PER_SEC;
       printf ("%11.1lf", elapsed_time);
-      printf ("  %2s", checkAscending (tempRan, size));
+      printf ("  %2s", checkSortedPermutation (tempRan, size, ranPrint));
  
       // descending data
       if (size <= 80000){
@@ -406,7 +2675,7 @@ void insertionSort(int arr[], int left, int right) {
       end_time = clock();
       elapsed_time = (end_time - start_time) / (double) CLOCKS_PER_SEC;
       printf ("%11.1lf", elapsed_time);
-      printf ("  %2s", checkAscending (tempRan, size));
+      printf ("  %2s", checkSortedPermutation (tempRan, size, ranPrint));
  
       // descending data
       start_time = clock ();
@@ -417,10 +2686,169 @@ void insertionSort(int arr[], int left, int right) {
       elapsed_time = (end_time - start_time) / (double) CLOCKS_PER_SEC;
       printf ("%14.1lf", elapsed_time);
       printf ("  %2s", checkAscValues (tempDes, size));
+      printf ("\n");
+
+      /* * * * * * * * * test of out-of-place quicksort * * * * * * * * * * * * */
+      int * oopScratch = (int *) malloc (size * sizeof(int));
+      for (i = 0; i< size; i++) {
+         tempAsc[i] = asc[i];
+         tempRan[i] = ran[i];
+         tempDes[i] = des[i];
+      }
+
+      // timing for out-of-place quicksort
+      printf ("out-of-place qsort %7d", size);
+
+      // ascending data
+      start_time = clock ();
+      oopQuicksort (tempAsc, oopScratch, size);
+      end_time = clock();
+      elapsed_time = (end_time - start_time) / (double) CLOCKS_PER_SEC;
+      printf ("%13.1lf", elapsed_time);
+      printf ("  %2s", checkAscValues (tempAsc, size));
+
+      // random data
+      start_time = clock ();
+      oopQuicksort (tempRan, oopScratch, size);
+      end_time = clock();
+      elapsed_time = (end_time - start_time) / (double) CLOCKS_PER_SEC;
+      printf ("%11.1lf", elapsed_time);
+      printf ("  %2s", checkSortedPermutation (tempRan, size, ranPrint));
+
+      // descending data
+      start_time = clock ();
+      oopQuicksort (tempDes, oopScratch, size);
+      end_time = clock();
+      elapsed_time = (end_time - start_time) / (double) CLOCKS_PER_SEC;
+      printf ("%14.1lf", elapsed_time);
+      printf ("  %2s", checkAscValues (tempDes, size));
+      printf ("\n");
+      free (oopScratch);
+
+      /* * * * * * * * * test of parallel samplesort * * * * * * * * * * * * * * */
+      for (i = 0; i< size; i++) {
+         tempAsc[i] = asc[i];
+         tempRan[i] = ran[i];
+         tempDes[i] = des[i];
+      }
+      double start_wall;
+
+      // timing for samplesort, wall clock since several threads run
+      printf ("samplesort         %7d", size);
+
+      // ascending data
+      start_wall = wallClock ();
+      samplesort (tempAsc, size, numThreads);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%13.1lf", elapsed_time);
+      printf ("  %2s", checkAscValues (tempAsc, size));
+
+      // random data
+      start_wall = wallClock ();
+      samplesort (tempRan, size, numThreads);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%11.1lf", elapsed_time);
+      printf ("  %2s", checkSortedPermutation (tempRan, size, ranPrint));
+
+      // descending data
+      start_wall = wallClock ();
+      samplesort (tempDes, size, numThreads);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%14.1lf", elapsed_time);
+      printf ("  %2s", checkAscValues (tempDes, size));
+      printf ("\n");
+
+      /* * * * * * * * * test of NUMA-aware quicksort * * * * * * * * * * * * * */
+      // test arrays placed slice by slice on the nodes that will sort them
+      int * numaAsc = numaAllocArray (size, nodes);
+      int * numaRan = numaAllocArray (size, nodes);
+      int * numaDes = numaAllocArray (size, nodes);
+      for (i = 0; i< size; i++) {
+         numaAsc[i] = asc[i];
+         numaRan[i] = ran[i];
+         numaDes[i] = des[i];
+      }
+
+      // timing for NUMA-aware quicksort, wall clock since several threads run
+      printf ("numa quicksort     %7d", size);
+
+      // ascending data
+      start_wall = wallClock ();
+      numaQuicksort (numaAsc, size, nodes);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%13.1lf", elapsed_time);
+      printf ("  %2s", checkAscValues (numaAsc, size));
+
+      // random data
+      start_wall = wallClock ();
+      numaQuicksort (numaRan, size, nodes);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%11.1lf", elapsed_time);
+      printf ("  %2s", checkSortedPermutation (numaRan, size, ranPrint));
+
+      // descending data
+      start_wall = wallClock ();
+      numaQuicksort (numaDes, size, nodes);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%14.1lf", elapsed_time);
+      printf ("  %2s", checkAscValues (numaDes, size));
+      printf ("\n");
+
+      free (numaAsc);
+      free (numaRan);
+      free (numaDes);
+
+      /* * * * * * * * * test of stable multiway mergesort * * * * * * * * * * */
+      // records carry their original position as payload; random keys are
+      // drawn from a small range so the stability check has ties to examine
+      recordType * recAsc = (recordType *) malloc (size * sizeof(recordType));
+      recordType * recRan = (recordType *) malloc (size * sizeof(recordType));
+      recordType * recDes = (recordType *) malloc (size * sizeof(recordType));
+      recordType * scratch = (recordType *) malloc (size * sizeof(recordType));
+      for (i = 0; i< size; i++) {
+         recAsc[i].key = asc[i];
+         recRan[i].key = ran[i] % 1000;
+         recDes[i].key = des[i];
+         recAsc[i].payload = recRan[i].payload = recDes[i].payload = i;
+      }
+      // fingerprint of the random keys, to catch a merge that loses records
+      recordKeys (recRan, size, tempRan);
+      fingerprintType recPrint = fingerprintArray (tempRan, size, verifyThreads);
+
+      // timing for multiway mergesort, wall clock since several threads run
+      printf ("stable mergesort   %7d", size);
+
+      // ascending data
+      start_wall = wallClock ();
+      multiwayMergesort (recAsc, scratch, size, numThreads);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%13.1lf", elapsed_time);
+      recordKeys (recAsc, size, tempAsc);
+      printf ("  %2s", checkAscValues (tempAsc, size));
+
+      // random data
+      start_wall = wallClock ();
+      multiwayMergesort (recRan, scratch, size, numThreads);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%11.1lf", elapsed_time);
+      recordKeys (recRan, size, tempRan);
+      printf ("  %2s", checkSortedPermutation (tempRan, size, recPrint));
+      printf (" %2s", checkStable (recRan, size));
+
+      // descending data
+      start_wall = wallClock ();
+      multiwayMergesort (recDes, scratch, size, numThreads);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%11.1lf", elapsed_time);
+      recordKeys (recDes, size, tempDes);
+      printf ("  %2s", checkAscValues (tempDes, size));
       printf ("\n\n");
 
-      
-      
+      free (recAsc);
+      free (recRan);
+      free (recDes);
+      free (scratch);
+
       // clean up copies of test arrays
       free (tempAsc);
       free (tempRan);
@@ -433,6 +2861,461 @@ void insertionSort(int arr[], int left, int right) {
       
    } // end of loop for testing procedures with different array sizes
 
+   /* * * * * * * * * test of segmented sort * * * * * * * * * * * * * * * * */
+   // segmented sort on one thread against the loop shows the saving per call;
+   // on numThreads threads against one thread, the gain from the threads. The
+   // skewed lengths put most elements in segments long enough for hybrid
+   // quicksort either way; the tiny segments, up to millions of them, are the
+   // case segmented sort is for, where the per-call cost is all there is
+   for (int shape = 0; shape < 2; shape++) {
+      if (shape == 0)
+         printf ("Segmented sort of random data, skewed segment lengths\n");
+      else
+         printf ("Segmented sort of random data, tiny segments of 1 to %d elements\n", segInsertionMax);
+      printf ("Algorithm             Size    Segments   Sort per Segment   Segmented 1 Thread   Segmented %d Threads\n",
+              numThreads);
+      int maxSize = (shape == 0) ? 5120000 : 40960000;
+      for (size = 40000; size <= maxSize; size *= 2) {
+         int * ran = (int *) malloc (size * sizeof(int));
+         int * tempRan = (int *) malloc (size * sizeof(int));
+         int * offsets = (int *) malloc ((size + 1) * sizeof(int));
+         int segments = (shape == 0) ? makeSegmentOffsets (offsets, size)
+                                     : makeTinySegmentOffsets (offsets, size);
+         int i;
+         for (i = 0; i< size; i++)
+            ran[i] = rand();
+
+         double start_wall, elapsed_time;
+         printf ("segmented sort     %7d %11d", size, segments);
+
+         // one hybrid quicksort call per segment
+         for (i = 0; i< size; i++)
+            tempRan[i] = ran[i];
+         start_wall = wallClock ();
+         for (int k = 0; k < segments; k++)
+           hybridQuicksort (tempRan + offsets[k], offsets[k+1] - offsets[k], numaMaxSize);
+         elapsed_time = wallClock () - start_wall;
+         printf ("%15.3lf", elapsed_time);
+         printf ("  %2s", checkSegments (tempRan, offsets, segments));
+
+         // one segmented sort call for all segments, on one thread
+         for (i = 0; i< size; i++)
+            tempRan[i] = ran[i];
+         start_wall = wallClock ();
+         segmentedSort (tempRan, offsets, segments, 1);
+         elapsed_time = wallClock () - start_wall;
+         printf ("%17.3lf", elapsed_time);
+         printf ("  %2s", checkSegments (tempRan, offsets, segments));
+
+         // and on numThreads threads
+         for (i = 0; i< size; i++)
+            tempRan[i] = ran[i];
+         start_wall = wallClock ();
+         segmentedSort (tempRan, offsets, segments, numThreads);
+         elapsed_time = wallClock () - start_wall;
+         printf ("%18.3lf", elapsed_time);
+         printf ("  %2s\n", checkSegments (tempRan, offsets, segments));
+
+         free (ran);
+         free (tempRan);
+         free (offsets);
+      }
+      printf ("\n");
+   }
+
+   /* * * * * * * * * test of incremental sorted array * * * * * * * * * * * */
+   // append random deltas to a sorted array of size elements: re-sorting all of it
+   // with improved quicksort against merging each delta, and against gathering
+   // lazyDeltas deltas per merge; times are per delta
+   size = 5120000;
+   printf ("Incremental sort of random deltas appended to %d sorted values, seconds per delta\n", size);
+   printf ("   Delta      Append and Resort     Incremental Merge     Lazy Merge\n");
+   for (int delta = 1000; delta <= 64000; delta *= 4) {
+      int * base = (int *) malloc (size * sizeof(int));
+      int * deltas = (int *) malloc (lazyDeltas * delta * sizeof(int));
+      int * resorted = (int *) malloc ((size + lazyDeltas * delta) * sizeof(int));
+      int i;
+      for (i = 0; i< size; i++)
+         base[i] = rand();
+      for (i = 0; i< lazyDeltas * delta; i++)
+         deltas[i] = rand();
+      hybridQuicksort (base, size, numaMaxSize);
+      double start_wall, elapsed_time;
+      printf ("%8d", delta);
+
+      // append each delta and re-sort everything
+      for (i = 0; i< size; i++)
+         resorted[i] = base[i];
+      int n = size;
+      start_wall = wallClock ();
+      for (int d = 0; d < lazyDeltas; d++) {
+        for (i = 0; i< delta; i++)
+          resorted[n++] = deltas[d * delta + i];
+        imprQuicksort (resorted, n);
+      }
+      elapsed_time = (wallClock () - start_wall) / lazyDeltas;
+      printf ("%20.4lf  %2s", elapsed_time, checkAscending (resorted, n));
+
+      // sort each delta alone and merge it straight away
+      sortedArrayType eager;
+      sortedArrayInit (&eager, base, size, 1);
+      start_wall = wallClock ();
+      for (int d = 0; d < lazyDeltas; d++)
+        sortedArrayAppend (&eager, &deltas[d * delta], delta);
+      elapsed_time = (wallClock () - start_wall) / lazyDeltas;
+      printf ("%18.4lf  %2s", elapsed_time, checkAscending (eager.a, eager.n));
+      sortedArrayFree (&eager);
+
+      // gather lazyDeltas deltas, then sort and merge them together
+      sortedArrayType lazy;
+      sortedArrayInit (&lazy, base, size, lazyDeltas * delta);
+      start_wall = wallClock ();
+      for (int d = 0; d < lazyDeltas; d++)
+        sortedArrayAppend (&lazy, &deltas[d * delta], delta);
+      elapsed_time = (wallClock () - start_wall) / lazyDeltas;
+      printf ("%14.4lf  %2s\n", elapsed_time, checkAscending (lazy.a, lazy.n));
+      sortedArrayFree (&lazy);
+
+      free (base);
+      free (deltas);
+      free (resorted);
+   }
+   printf ("\n");
+
+   /* * * * * * * * * partition profile of the quicksorts * * * * * * * * * * */
+   // profiled runs start from the plain runs' srand seed; Same checks that both
+   // runs left rand() in the same state, so the profiler did not change how many
+   // pivots were drawn, and sorted alike; overhead is the best of three runs of each
+   printf ("Partition profile, improved and hybrid quicksort\n");
+   printf ("Data Set             Size  Algorithm             Plain     Profiled  Overhead  Same\n");
+   for (int set = 0; set < 2; set++) {
+      size = (set == 0) ? 5120000 : 40000;
+      int * data = (int *) malloc (size * sizeof(int));
+      int * plain = (int *) malloc (size * sizeof(int));
+      int * profiled = (int *) malloc (size * sizeof(int));
+      int i;
+      for (i = 0; i< size; i++)
+         data[i] = (set == 0) ? rand() : rand() % 16;
+      clock_t start_time;
+      double elapsed_time;
+      profileType profiles [2];
+      profileInit (&profiles[0], "imprQuicksort");
+      profileInit (&profiles[1], "hybridQuicksort");
+      for (int alg = 0; alg < 2; alg++) {
+        double plainTime = 0, profiledTime = 0;
+        int same = 1;
+        for (int run = 0; run < 3; run++) {
+          profileType scratch;
+          profileInit (&scratch, profiles[alg].name);
+          profileType * p = (run == 0) ? &profiles[alg] : &scratch;
+          for (i = 0; i< size; i++)
+             plain[i] = profiled[i] = data[i];
+          srand (run + 1);
+          start_time = clock ();
+          if (alg == 0)
+            imprQuicksort (plain, size);
+          else
+            hybridQuicksort (plain, size, numaMaxSize);
+          elapsed_time = (clock () - start_time) / (double) CLOCKS_PER_SEC;
+          plainTime = (run == 0 || elapsed_time < plainTime) ? elapsed_time : plainTime;
+          int plainNext = rand ();
+          srand (run + 1);
+          start_time = clock ();
+          if (alg == 0)
+            profiledImprQuicksort (profiled, size, p);
+          else
+            profiledHybridQuicksort (profiled, size, numaMaxSize, p);
+          elapsed_time = (clock () - start_time) / (double) CLOCKS_PER_SEC;
+          profiledTime = (run == 0 || elapsed_time < profiledTime) ? elapsed_time : profiledTime;
+          same = same && rand () == plainNext
+                 && memcmp (plain, profiled, size * sizeof(int)) == 0;
+          profileFree (&scratch);
+        }
+        printf ("%-16s %8d  %-16s %10.3lf %12.3lf %8.1lf%%  %s\n",
+                (set == 0) ? "random" : "16 distinct values", size, profiles[alg].name,
+                plainTime, profiledTime, 100 * (profiledTime - plainTime) / plainTime,
+                same ? "yes" : "NO");
+      }
+      for (int alg = 0; alg < 2; alg++) {
+        profilePrint (&profiles[alg]);
+        if (profileFolded && set == 0) {
+          char path [64];
+          snprintf (path, sizeof(path), "%s.folded", profiles[alg].name);
+          if (profileWriteFolded (&profiles[alg], path) == 0)
+            printf ("  folded stacks written to %s\n", path);
+        }
+        profileFree (&profiles[alg]);
+      }
+      printf ("\n");
+      free (data);
+      free (plain);
+      free (profiled);
+   }
+
+   /* * * * * * * * * * cost of verification * * * * * * * * * * * * * * * * */
+   // the plain loop against the SSE2 checks on one thread and on verifyThreads,
+   // then the fingerprint; the last column overwrites one value of the sorted
+   // array with its neighbour, which keeps it sorted but must fail the fingerprint
+   printf ("Verification of sorted random data, seconds\n");
+   printf ("    Size   Scalar  SIMD 1 thread  SIMD %d threads  Fingerprint 1  Fingerprint %d  Duplicate\n",
+           verifyThreads, verifyThreads);
+   for (size = 5120000; size <= 40960000; size *= 8) {
+      int * ran = (int *) malloc (size * sizeof(int));
+      int i;
+      for (i = 0; i< size; i++)
+         ran[i] = rand();
+      fingerprintType before = fingerprintArray (ran, size, verifyThreads);
+      radixSort (ran, size);
+      double start_wall, elapsed_time;
+      long found;
+      printf ("%8d", size);
+
+      start_wall = wallClock ();
+      found = verifyAscendingScalar (ran, size);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%9.4lf %2s", elapsed_time, (found < 0) ? "ok" : "NO");
+
+      int threadCounts [2] = {1, verifyThreads};   // the two thread columns
+      for (int t = 0; t < 2; t++) {
+        start_wall = wallClock ();
+        found = verifyAscending (ran, size, threadCounts[t]);
+        elapsed_time = wallClock () - start_wall;
+        printf ("%13.4lf %2s", elapsed_time, (found < 0) ? "ok" : "NO");
+      }
+      for (int t = 0; t < 2; t++) {
+        start_wall = wallClock ();
+        fingerprintType after = fingerprintArray (ran, size, threadCounts[t]);
+        elapsed_time = wallClock () - start_wall;
+        printf ("%12.4lf %2s", elapsed_time, fingerprintEqual (before, after) ? "ok" : "NP");
+      }
+
+      ran[size / 2] = ran[size / 2 - 1];
+      printf ("%9s\n", checkSortedPermutation (ran, size, before));
+      free (ran);
+   }
+   printf ("\n");
+
+   /* * * * * * * * * * test of sort-based group-by * * * * * * * * * * * * * */
+   // (key, count) pairs from sorting then scanning, against grouping fused into
+   // the sort, its distinct-keys form and its parallel form; every result is
+   // checked against the radix sort and scan. The sort-then-scan baselines are
+   // radix and smart sort rather than imprQuicksort: its two-way partition is
+   // quadratic on a few distinct keys, so it would not finish the first rows
+   size = 5120000;
+   printf ("Group-by count of %d values, seconds\n", size);
+   printf ("Data Set        Groups   Radix + Scan   Smart + Scan   Fused Count   Fused Distinct   Parallel Fused\n");
+   for (int set = 0; set < 4; set++) {
+      int * data = (int *) malloc (size * sizeof(int));
+      int * temp = (int *) malloc (size * sizeof(int));
+      int * expectKeys = (int *) malloc (size * sizeof(int));
+      int * expectCounts = (int *) malloc (size * sizeof(int));
+      int * keys = (int *) malloc (size * sizeof(int));
+      int * counts = (int *) malloc (size * sizeof(int));
+      char * setName [4] = {"16 distinct", "1000 distinct", "Zipf", "random"};
+      int i;
+      if (set == 2)
+         zipfFill (data, size);
+      else
+         for (i = 0; i< size; i++)
+            data[i] = (set == 0) ? rand() % 16 : (set == 1) ? rand() % 1000 : rand();
+      double start_wall, elapsed_time;
+      long expected, groups;
+
+      memcpy (temp, data, size * sizeof(int));
+      start_wall = wallClock ();
+      radixSort (temp, size);
+      expected = scanGroups (temp, size, expectKeys, expectCounts);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%-14s %7ld %14.3lf", setName[set], expected, elapsed_time);
+
+      memcpy (temp, data, size * sizeof(int));
+      start_wall = wallClock ();
+      smartSort (temp, size);
+      groups = scanGroups (temp, size, keys, counts);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%12.3lf %2s", elapsed_time, (groups == expected
+              && memcmp (keys, expectKeys, groups * sizeof(int)) == 0
+              && memcmp (counts, expectCounts, groups * sizeof(int)) == 0) ? "ok" : "NO");
+
+      memcpy (temp, data, size * sizeof(int));
+      start_wall = wallClock ();
+      groups = groupCount (temp, size, keys, counts);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%11.3lf %2s", elapsed_time, (groups == expected
+              && memcmp (keys, expectKeys, groups * sizeof(int)) == 0
+              && memcmp (counts, expectCounts, groups * sizeof(int)) == 0) ? "ok" : "NO");
+
+      memcpy (temp, data, size * sizeof(int));
+      start_wall = wallClock ();
+      groups = groupCount (temp, size, keys, NULL);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%14.3lf %2s", elapsed_time, (groups == expected
+              && memcmp (keys, expectKeys, groups * sizeof(int)) == 0) ? "ok" : "NO");
+
+      memcpy (temp, data, size * sizeof(int));
+      start_wall = wallClock ();
+      groups = parallelGroupCount (temp, size, keys, counts, numThreads);
+      elapsed_time = wallClock () - start_wall;
+      printf ("%14.3lf %2s\n", elapsed_time, (groups == expected
+              && memcmp (keys, expectKeys, groups * sizeof(int)) == 0
+              && memcmp (counts, expectCounts, groups * sizeof(int)) == 0) ? "ok" : "NO");
+
+      free (data);
+      free (temp);
+      free (expectKeys);
+      free (expectCounts);
+      free (keys);
+      free (counts);
+   }
+   printf ("\n");
+
+   /* * * * * * * * * smart sort calibration * * * * * * * * * * * * * * * * */
+   // every fixed engine beside smartSort, on the kinds of data smartSort tells
+   // apart; the smart* thresholds are set from this table and the two sweeps
+   // after it; "-" marks runs skipped for taking quadratic time or a count
+   // for every int
+   #define numSorts 9
+   sortType sortArray [numSorts] = {{"improved quicksort", imprQuicksort,          quadraticOnFew },
+                                     {"hybrid quicksort  ", hybridQuicksortDefault, quadraticOnFew },
+                                     {"run merge         ", runMergeSort,           0              },
+                                     {"reversal          ", reversalSort,           0              },
+                                     {"counting sort     ", countingSortDefault,    needsSmallRange},
+                                     {"radix sort        ", radixSort,              0              },
+                                     {"oop quicksort     ", oopQuicksortDefault,    0              },
+                                     {"samplesort        ", samplesortDefault,      0              },
+                                     {"smart sort        ", smartSort,              0              }};
+   printf ("Smart sort calibration, seconds; 16 Keys are drawn from all ints, Range n/2 from 0 to n/2\n");
+   printf ("Algorithm             Size     Ascending Order   Random Order  Descending Order      16 Keys    Range n/2\n");
+   for (size = 40000; size <= 5120000; size *= 2) {
+      int * asc = (int *) malloc (size * sizeof(int));
+      int * ran = (int *) malloc (size * sizeof(int));
+      int * des = (int *) malloc (size * sizeof(int));
+      int * few = (int *) malloc (size * sizeof(int));
+      int * small = (int *) malloc (size * sizeof(int));
+      int * temp = (int *) malloc (size * sizeof(int));
+      int keys [16];
+      int i;
+      for (i = 0; i < 16; i++)
+         keys[i] = rand();
+      for (i = 0; i< size; i++) {
+         asc[i] = 2*i;
+         ran[i] = rand();
+         des[i] = 2*(size - i - 1);
+         few[i] = keys[rand() % 16];
+         small[i] = rand() % (size / 2);
+      }
+      int * sets [5] = {asc, ran, des, few, small};
+      int setSkip [5] = {0, needsSmallRange, 0, quadraticOnFew | needsSmallRange, 0};
+      int setWidth [5] = {13, 11, 14, 11, 11};
+      fingerprintType prints [5];
+      for (int set = 0; set < 5; set++)
+         prints[set] = fingerprintArray (sets[set], size, verifyThreads);
+
+      for (int alg = 0; alg < numSorts; alg++) {
+        double start_wall, elapsed_time;
+        printf ("%s %7d", sortArray[alg].name, size);
+        for (int set = 0; set < 5; set++) {
+          if (sortArray[alg].skip & setSkip[set]) {
+            printf ("%*s    ", setWidth[set], "-");
+            continue;
+          }
+          for (i = 0; i< size; i++)
+             temp[i] = sets[set][i];
+          start_wall = wallClock ();
+          sortArray[alg].proc (temp, size);
+          elapsed_time = wallClock () - start_wall;
+          printf ("%*.3lf", setWidth[set], elapsed_time);
+          printf ("  %2s", checkSortedPermutation (temp, size, prints[set]));
+        }
+        printf ("\n");
+      }
+      printf ("\n");
+
+      free (asc);
+      free (ran);
+      free (des);
+      free (few);
+      free (small);
+      free (temp);
+   }
+
+   // key range sweep: counting sort against radix sort as the range grows,
+   // which sets smartCountFactor
+   size = 1280000;
+   printf ("Smart sort key range sweep, %d values, seconds\n", size);
+   printf ("Range / n   Counting Sort   Radix Sort   Smart Sort\n");
+   {
+      int * data = (int *) malloc (size * sizeof(int));
+      int * temp = (int *) malloc (size * sizeof(int));
+      int rangeAlgs [3] = {4, 5, 8};   // counting, radix and smart sort in sortArray
+      for (double factor = 0.25; factor <= 16; factor *= 2) {
+        long range = (long) (factor * size);
+        int i;
+        for (i = 0; i< size; i++)
+           data[i] = (int) (((long) rand() * RAND_MAX + rand()) % range);
+        fingerprintType print = fingerprintArray (data, size, verifyThreads);
+        printf ("%9.2lf", factor);
+        for (int k = 0; k < 3; k++) {
+          double start_wall, elapsed_time;
+          for (i = 0; i< size; i++)
+             temp[i] = data[i];
+          start_wall = wallClock ();
+          sortArray[rangeAlgs[k]].proc (temp, size);
+          elapsed_time = wallClock () - start_wall;
+          printf ("%14.4lf %2s", elapsed_time, checkSortedPermutation (temp, size, print));
+        }
+        printf ("\n");
+      }
+      printf ("\n");
+      free (data);
+      free (temp);
+   }
+
+   // small arrays: where insertion sort stops paying and radix sort takes over,
+   // which sets smartInsertionMax; microseconds per sort, the best of five
+   // batches of about 200000 values each
+   printf ("Smart sort small array sweep, microseconds per sort\n");
+   printf ("   Size  Data       Insertion     Hybrid  Oop Quick      Radix      Smart\n");
+   {
+      #define numSmallSorts 5
+      sortType smallArray [numSmallSorts] = {{"insertion", insertionSortDefault,   0},
+                                              {"hybrid",    hybridQuicksortDefault, 0},
+                                              {"oop",       oopQuicksortDefault,    0},
+                                              {"radix",     radixSort,              0},
+                                              {"smart",     smartSort,              0}};
+      int * data = (int *) malloc (2048 * sizeof(int));
+      int * temp = (int *) malloc (2048 * sizeof(int));
+      for (size = 32; size <= 2048; size *= 2) {
+        for (int set = 0; set < 2; set++) {
+          int i;
+          for (i = 0; i< size; i++)
+             data[i] = (set == 0) ? rand() : rand() % 16 * 100000000;
+          printf ("%7d  %-8s", size, (set == 0) ? "random" : "16 keys");
+          int reps = 200000 / size;
+          for (int alg = 0; alg < numSmallSorts; alg++) {
+            double best = 0;
+            for (int batch = 0; batch < 5; batch++) {
+              double start_wall = wallClock ();
+              for (int r = 0; r < reps; r++) {
+                for (i = 0; i< size; i++)
+                   temp[i] = data[i];
+                smallArray[alg].proc (temp, size);
+              }
+              double elapsed_time = (wallClock () - start_wall) / reps;
+              best = (batch == 0 || elapsed_time < best) ? elapsed_time : best;
+            }
+            printf ("%11.2lf", best * 1e6);
+            if (checkAscending (temp, size)[0] != 'o')
+              printf (" NO");
+          }
+          printf ("\n");
+        }
+      }
+      printf ("\n");
+      free (data);
+      free (temp);
+   }
+
 /* * * * * * * * * test of hybrid quicksort * * * * * * * * * * * * * * */
 for (int maxSize = 4; maxSize <= 11; maxSize++){
   printf("Testing size %i\n", maxSize);
@@ -447,6 +3330,8 @@ for (int maxSize = 4; maxSize <= 11; maxSize++){
          ran[i] = rand();
          des[i] = 2*(size - i - 1); 
       } 
+      // fingerprint of the random data, to catch a sort that loses values
+      fingerprintType ranPrint = fingerprintArray (ran, size, verifyThreads);
  
       // timing variables
       clock_t start_time, end_time;
@@ -484,7 +3369,7 @@ for (int maxSize = 4; maxSize <= 11; maxSize++){
      end_time = clock();
      elapsed_time = (end_time - start_time) / (double) CLOCKS_PER_SEC;
      printf ("%11.1lf", elapsed_time);
-     printf ("  %2s", checkAscending (tempRan, size));
+     printf ("  %2s", checkSortedPermutation (tempRan, size, ranPrint));
 
      // descending data
      start_time = clock ();
@@ -509,4 +3394,5 @@ for (int maxSize = 4; maxSize <= 11; maxSize++){
    }
   }
    return 0;
- }
\ No newline at end of file
+ }
+ #endif
@@ -0,0 +1,60 @@
+/* serial selection shared by the partition timing program and the sort service
+ *
+ *    a random pivot and a three-way split into smaller, equal and larger
+ *    elements, so runs of equal values and arrays already in order cost no
+ *    more than distinct values in random order
+ */
+
+ #ifndef selectionIncluded
+ #define selectionIncluded
+
+ #include <stdlib.h>   // for rand
+
+/** *******************************************************************************
+  * serial selection with a three-way split                                        *
+  *    in brief: like kthElement, but with a random pivot and a three-way split   *
+  *              into smaller, equal and larger elements, since the candidates     *
+  *              parallel selection leaves are often in order or full of copies   *
+  *              of the pivots, which send invariant5 to one element per level     *
+  * @param   c      the array to be searched                                       *
+  * @param   size   the size of array c                                            *
+  * @param   k      the kth smallest element, 1 <= k <= size                       *
+  * @post    elements of c are permuted, so that c[k-1] holds the kth smallest     *
+  *          element, c[0], ..., c[k-2] <= c[k-1] and c[k], ... >= c[k-1]          *
+  * @returns value of kth smallest element                                         *
+  *********************************************************************************/
+ static int threeWaySelect (int c[ ], long size, long k) {
+   long left = 0;
+   long right = size - 1;
+   long target = k - 1;
+   int temp;
+
+   while (left < right) {
+     int pivot = c[left + rand() % (right - left + 1)];
+     long lt = left;
+     long i = left;
+     long gt = right;
+     while (i <= gt) {
+       if (c[i] < pivot) {
+         temp = c[lt]; c[lt] = c[i]; c[i] = temp;
+         lt++;
+         i++;
+       }
+       else if (c[i] > pivot) {
+         temp = c[i]; c[i] = c[gt]; c[gt] = temp;
+         gt--;
+       }
+       else
+         i++;
+     }
+     if (target < lt)
+       right = lt - 1;
+     else if (target > gt)
+       left = gt + 1;
+     else
+       return pivot;
+   }
+   return c[target];
+ }
+
+ #endif
@@ -0,0 +1,894 @@
+/* local sort and selection service: a daemon that sorts, partitions and selects
+ * for other processes over a Unix domain socket, and a load generator for it
+ *
+ *    ./sortService                 start a server, run the load table, stop it
+ *    ./sortService server          run only the server, until a client stops it
+ *    ./sortService client C S      run C clients sending requests of S values
+ *    ./sortService stop            ask a running server to stop
+ *
+ * build with  gcc -O2 -pthread sortService.c -o sortService
+ */
+
+ #define omitDriver    // reuse the sorts in quicksortComparisons.c without its main
+ #include "quicksortComparisons.c"
+ #include "selection.h"   // for threeWaySelect
+ #include <errno.h>       // for errno, EINTR, EINVAL, EPERM
+ #include <fcntl.h>       // for fcntl, F_GET_SEALS, F_SEAL_SHRINK
+ #include <signal.h>      // for signal, SIGPIPE
+ #include <sys/mman.h>    // for memfd_create, mmap
+ #include <sys/socket.h>  // for socket, sendmsg, recvmsg, SCM_RIGHTS, SO_PEERCRED
+ #include <sys/stat.h>    // for fstat, umask, chmod
+ #include <sys/un.h>      // for sockaddr_un
+ #include <sys/wait.h>    // for waitpid
+
+ #define servicePath "/tmp/sortService.sock"  // socket the server listens on
+ #define serviceWorkers 4         // worker threads that run requests
+ #define serviceBatch 16          // most small requests a worker takes from the queue at once
+ #define serviceSmall 4096        // requests of up to this many values are small, and
+                                  // travel inline through the socket
+ #define serviceSlots 64          // warm buffers of serviceSmall values, pre-faulted at start
+ #define serviceBacklog 64        // pending connections the socket queues
+ #define loadValues (1 << 24)     // values sent by all clients together for one table row
+ #define loadRequestsMax 40000    // but never more than this many requests per row
+ #define loadRequestsMin 16       // nor fewer than this many per client
+
+ #define opSort 0        // sort the values
+ #define opPartition 1   // partition the values around the one at index k
+ #define opKth 2         // select the value of rank k
+ #define opPercentile 3  // select the value at the given percentile
+ #define opAttach 4      // map the memfd passed with the request for later shared requests
+ #define opStop 5        // stop the server
+
+ /** *******************************************************************************
+  * request header a client sends; an inline request is followed by its n values   *
+  *********************************************************************************/
+ typedef struct serviceRequest {
+   int op;          // opSort, ..., opStop
+   int shared;      // 1 = the values are the first n of the attached memfd
+   long n;          // number of values, or bytes to map for opAttach
+   long k;          // rank for opKth, index of the pivot for opPartition
+   double percent;  // percentile for opPercentile, from 0 to 100
+ } requestType;
+
+ /** *******************************************************************************
+  * reply header the server sends; an inline sort or partition that succeeded is   *
+  * followed by the n values it rearranged                                         *
+  *********************************************************************************/
+ typedef struct serviceReply {
+   int status;      // 0 = done, otherwise an errno value
+   int value;       // value selected, or the pivot for opPartition
+   long index;      // rank selected, or the final index of the pivot
+ } replyType;
+
+ /** *******************************************************************************
+  * one client connection; it has at most one request outstanding, so it is also  *
+  * the job the connection thread hands to the worker pool                         *
+  *********************************************************************************/
+ typedef struct serviceConnection {
+   int fd;
+   int slot;                  // index of the warm buffer this connection holds, or -1
+   int * spill;               // own buffer for inline requests that are not small
+   long spillSize;
+   int * shared;              // the attached memfd, mapped, or NULL
+   long sharedBytes;
+   requestType req;           // request being served
+   replyType reply;
+   int * values;              // where its values are
+   int done;                  // set by the worker when the reply is ready
+   pthread_mutex_t lock;
+   pthread_cond_t finished;
+   struct serviceConnection * next;   // link in the work queue
+ } connectionType;
+
+ /** *******************************************************************************
+  * state the server threads share                                                 *
+  *********************************************************************************/
+ typedef struct serviceState {
+   int listenFd;
+   pthread_mutex_t lock;              // guards everything below
+   pthread_cond_t work;               // signalled when a request is queued
+   connectionType * head;             // work queue, oldest first
+   connectionType * tail;
+   int * slots [serviceSlots];        // warm buffers
+   int slotFree [serviceSlots];
+   long requests;                     // requests served
+   long batches;                      // trips workers made to the queue
+   int stopping;
+ } serviceType;
+
+ serviceType service;
+
+ /* * * * * * * * * * * * * operations the service performs * * * * * * * * * * * */
+
+ /** *******************************************************************************
+  * nearest rank for a percentile                                                  *
+  * @param  n        the number of values, at least 1                              *
+  * @param  percent  the percentile, from 0 to 100                                 *
+  * @returns  the rank, from 0 to n-1, nearest percent / 100 of the way up         *
+  *********************************************************************************/
+ long percentileRank (long n, double percent) {
+   long rank = (long) (percent / 100 * (n - 1) + 0.5);
+   return (rank < 0) ? 0 : (rank > n - 1) ? n - 1 : rank;
+ }
+
+ /** *******************************************************************************
+  * carry out one request on its values                                            *
+  * @param  req    the request                                                     *
+  * @param  a      the n values of the request                                     *
+  * @param  reply  the reply to fill in                                            *
+  * @post  a is sorted, partitioned or selected in, as the request asks, and reply *
+  *        holds the result, or status EINVAL with a unchanged if the request is   *
+  *        not valid                                                               *
+  *********************************************************************************/
+ void serviceExecute (requestType * req, int a [ ], replyType * reply) {
+   long n = req->n;
+   reply->status = 0;
+   reply->value = 0;
+   reply->index = 0;
+   if (n < 0 || n > INT_MAX || (n == 0 && req->op != opSort)) {
+     reply->status = EINVAL;
+     return;
+   }
+   switch (req->op) {
+     case opSort:
+       smartSort (a, (int) n);
+       break;
+     case opPartition: {
+       if (req->k < 0 || req->k >= n) {
+         reply->status = EINVAL;
+         return;
+       }
+       int temp = a[req->k];
+       a[req->k] = a[0];
+       a[0] = temp;
+       reply->index = basicPartition (a, (int) n, 0, (int) n - 1);
+       reply->value = a[reply->index];
+       break;
+     }
+     case opKth:
+       if (req->k < 0 || req->k >= n) {
+         reply->status = EINVAL;
+         return;
+       }
+       reply->index = req->k;
+       reply->value = threeWaySelect (a, n, req->k + 1);
+       break;
+     case opPercentile:
+       if (!(req->percent >= 0 && req->percent <= 100)) {
+         reply->status = EINVAL;
+         return;
+       }
+       reply->index = percentileRank (n, req->percent);
+       reply->value = threeWaySelect (a, n, reply->index + 1);
+       break;
+     default:
+       reply->status = EINVAL;
+   }
+ }
+
+ /* * * * * * * * * * * * * * * socket helper functions * * * * * * * * * * * * * * */
+
+ /** *******************************************************************************
+  * read exactly bytes bytes from a socket                                         *
+  * @returns  0, or -1 if the socket closed or failed first                        *
+  *********************************************************************************/
+ int readFully (int fd, void * buffer, long bytes) {
+   char * p = (char *) buffer;
+   while (bytes > 0) {
+     ssize_t got = read (fd, p, bytes);
+     if (got < 0 && errno == EINTR)
+       continue;
+     if (got <= 0)
+       return -1;
+     p += got;
+     bytes -= got;
+   }
+   return 0;
+ }
+
+ /** *******************************************************************************
+  * write exactly bytes bytes to a socket                                          *
+  * @returns  0, or -1 if the socket closed or failed first                        *
+  *********************************************************************************/
+ int writeFully (int fd, const void * buffer, long bytes) {
+   const char * p = (const char *) buffer;
+   while (bytes > 0) {
+     ssize_t put = send (fd, p, bytes, MSG_NOSIGNAL);
+     if (put < 0 && errno == EINTR)
+       continue;
+     if (put <= 0)
+       return -1;
+     p += put;
+     bytes -= put;
+   }
+   return 0;
+ }
+
+ /** *******************************************************************************
+  * read a request header, and the descriptor passed with it, if any               *
+  * @param  fd      the connection                                                 *
+  * @param  req     where to put the header                                        *
+  * @param  passed  where to put the descriptor passed, or -1 if none              *
+  * @returns  0, or -1 if the socket closed or failed first, in which case any    *
+  *           descriptor received with the partial header is closed               *
+  *********************************************************************************/
+ int readRequest (int fd, requestType * req, int * passed) {
+   char control [CMSG_SPACE (sizeof(int))];
+   struct iovec iov = { req, sizeof(requestType) };
+   struct msghdr msg;
+   memset (&msg, 0, sizeof(msg));
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = control;
+   msg.msg_controllen = sizeof(control);
+
+   *passed = -1;
+   ssize_t got;
+   do
+     got = recvmsg (fd, &msg, MSG_CMSG_CLOEXEC);
+   while (got < 0 && errno == EINTR);
+   if (got <= 0)
+     return -1;
+   for (struct cmsghdr * c = CMSG_FIRSTHDR (&msg); c != NULL; c = CMSG_NXTHDR (&msg, c)) {
+     if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+       if (*passed >= 0)
+         close (*passed);                       // keep only the last descriptor sent
+       memcpy (passed, CMSG_DATA (c), sizeof(int));
+     }
+   }
+   if (readFully (fd, (char *) req + got, sizeof(requestType) - got) != 0) {
+     if (*passed >= 0)
+       close (*passed);
+     *passed = -1;
+     return -1;
+   }
+   return 0;
+ }
+
+ /** *******************************************************************************
+  * send a request header with a descriptor, for opAttach                          *
+  * @returns  0, or -1 if the send failed                                          *
+  *********************************************************************************/
+ int sendWithDescriptor (int fd, requestType * req, int passed) {
+   char control [CMSG_SPACE (sizeof(int))];
+   memset (control, 0, sizeof(control));
+   struct iovec iov = { req, sizeof(requestType) };
+   struct msghdr msg;
+   memset (&msg, 0, sizeof(msg));
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = control;
+   msg.msg_controllen = sizeof(control);
+   struct cmsghdr * c = CMSG_FIRSTHDR (&msg);
+   c->cmsg_level = SOL_SOCKET;
+   c->cmsg_type = SCM_RIGHTS;
+   c->cmsg_len = CMSG_LEN (sizeof(int));
+   memcpy (CMSG_DATA (c), &passed, sizeof(int));
+
+   ssize_t put;
+   do
+     put = sendmsg (fd, &msg, MSG_NOSIGNAL);
+   while (put < 0 && errno == EINTR);
+   if (put <= 0)
+     return -1;
+   return writeFully (fd, (char *) req + put, sizeof(requestType) - put);
+ }
+
+ /** *******************************************************************************
+  * address of the service socket                                                  *
+  *********************************************************************************/
+ struct sockaddr_un serviceAddress (const char * path) {
+   struct sockaddr_un address;
+   memset (&address, 0, sizeof(address));
+   address.sun_family = AF_UNIX;
+   strncpy (address.sun_path, path, sizeof(address.sun_path) - 1);
+   return address;
+ }
+
+ /** *******************************************************************************
+  * connect to the service                                                         *
+  * @param  path   the socket                                                      *
+  * @param  tries  attempts 10 ms apart, to wait for a server that is starting     *
+  * @returns  the connection, or -1 if none was made                               *
+  *********************************************************************************/
+ int serviceConnect (const char * path, int tries) {
+   struct sockaddr_un address = serviceAddress (path);
+   for (int t = 0; t < tries; t++) {
+     int fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+     if (fd < 0)
+       return -1;
+     if (connect (fd, (struct sockaddr *) &address, sizeof(address)) == 0)
+       return fd;
+     close (fd);
+     usleep (10000);
+   }
+   return -1;
+ }
+
+ /* * * * * * * * * * * * * * * * * * * * server * * * * * * * * * * * * * * * * * */
+
+ /** *******************************************************************************
+  * worker thread: take the oldest request from the queue, together with up to     *
+  * serviceBatch - 1 more if they are all small, run them and wake their           *
+  * connections; batching keeps the queue lock and the wake-ups off the path of   *
+  * each small request when many arrive at once                                   *
+  *********************************************************************************/
+ void * serviceWorker (void * arg) {
+   connectionType * batch [serviceBatch];
+   while (1) {
+     pthread_mutex_lock (&service.lock);
+     while (service.head == NULL && !service.stopping)
+       pthread_cond_wait (&service.work, &service.lock);
+     if (service.head == NULL) {
+       pthread_mutex_unlock (&service.lock);
+       return NULL;
+     }
+     int count = 0;
+     do {
+       batch[count++] = service.head;
+       service.head = service.head->next;
+     } while (count < serviceBatch && batch[0]->req.n <= serviceSmall
+              && service.head != NULL && service.head->req.n <= serviceSmall);
+     if (service.head == NULL)
+       service.tail = NULL;
+     service.requests += count;
+     service.batches++;
+     pthread_mutex_unlock (&service.lock);
+
+     for (int j = 0; j < count; j++) {
+       connectionType * c = batch[j];
+       serviceExecute (&c->req, c->values, &c->reply);
+       pthread_mutex_lock (&c->lock);
+       c->done = 1;
+       pthread_cond_signal (&c->finished);
+       pthread_mutex_unlock (&c->lock);
+     }
+   }
+ }
+
+ /** *******************************************************************************
+  * hand a connection's request to the worker pool and wait for the reply         *
+  *********************************************************************************/
+ void serviceSubmit (connectionType * c) {
+   c->done = 0;
+   c->next = NULL;
+   pthread_mutex_lock (&service.lock);
+   if (service.tail == NULL)
+     service.head = c;
+   else
+     service.tail->next = c;
+   service.tail = c;
+   pthread_cond_signal (&service.work);
+   pthread_mutex_unlock (&service.lock);
+
+   pthread_mutex_lock (&c->lock);
+   while (!c->done)
+     pthread_cond_wait (&c->finished, &c->lock);
+   pthread_mutex_unlock (&c->lock);
+ }
+
+ /** *******************************************************************************
+  * take a warm buffer for a new connection                                        *
+  * @returns  its index, or -1 when all are in use                                 *
+  *********************************************************************************/
+ int takeSlot ( ) {
+   int slot = -1;
+   pthread_mutex_lock (&service.lock);
+   for (int s = 0; s < serviceSlots && slot < 0; s++) {
+     if (service.slotFree[s]) {
+       service.slotFree[s] = 0;
+       slot = s;
+     }
+   }
+   pthread_mutex_unlock (&service.lock);
+   return slot;
+ }
+
+ /** *******************************************************************************
+  * return a connection's warm buffer                                              *
+  *********************************************************************************/
+ void returnSlot (int slot) {
+   if (slot < 0)
+     return;
+   pthread_mutex_lock (&service.lock);
+   service.slotFree[slot] = 1;
+   pthread_mutex_unlock (&service.lock);
+ }
+
+ /** *******************************************************************************
+  * map the memfd a client attaches; MAP_POPULATE faults the pages in now, so the  *
+  * requests that use it find them ready                                           *
+  *    the memfd must already hold bytes bytes and be sealed against shrinking,    *
+  *    since touching a page past its end raises SIGBUS and would stop the server  *
+  *    for every client                                                            *
+  * @returns  0, or an errno value                                                 *
+  *********************************************************************************/
+ int attachShared (connectionType * c, int passed, long bytes) {
+   if (passed < 0)
+     return EINVAL;
+   struct stat st;
+   int seals = fcntl (passed, F_GET_SEALS);
+   if (bytes <= 0 || fstat (passed, &st) != 0 || st.st_size < bytes
+       || seals < 0 || !(seals & F_SEAL_SHRINK)) {
+     close (passed);
+     return EINVAL;
+   }
+   if (c->shared != NULL)
+     munmap (c->shared, c->sharedBytes);
+   c->shared = (int *) mmap (NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             passed, 0);
+   close (passed);
+   if (c->shared == MAP_FAILED) {
+     c->shared = NULL;
+     c->sharedBytes = 0;
+     return errno;
+   }
+   c->sharedBytes = bytes;
+   return 0;
+ }
+
+ /** *******************************************************************************
+  * whether the process at the other end of a connection runs as the same user    *
+  * as the server                                                                  *
+  *********************************************************************************/
+ int sameUser (int fd) {
+   struct ucred peer;
+   socklen_t length = sizeof(peer);
+   if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) != 0)
+     return 0;
+   return peer.uid == getuid ();
+ }
+
+ /** *******************************************************************************
+  * find room for the values of an inline request: the connection's warm buffer   *
+  * for a small one, else its own buffer, grown when needed                        *
+  * @returns  the buffer, or NULL if out of memory                                 *
+  *********************************************************************************/
+ int * inlineBuffer (connectionType * c, long n) {
+   if (n <= serviceSmall && c->slot >= 0)
+     return service.slots[c->slot];
+   if (n > c->spillSize) {
+     free (c->spill);
+     c->spill = (int *) malloc ((n > 0 ? n : 1) * sizeof(int));
+     c->spillSize = (c->spill == NULL) ? 0 : n;
+   }
+   return c->spill;
+ }
+
+ /** *******************************************************************************
+  * connection thread: read requests and their values, have the workers run them, *
+  * and send the replies, until the client hangs up                                *
+  *********************************************************************************/
+ void * serviceConnection (void * arg) {
+   connectionType * c = (connectionType *) arg;
+   int passed = -1;
+   while (readRequest (c->fd, &c->req, &passed) == 0) {
+     requestType * req = &c->req;
+     memset (&c->reply, 0, sizeof(replyType));
+     if (req->op == opAttach) {
+       c->reply.status = attachShared (c, passed, req->n);
+       passed = -1;
+     }
+     else if (req->op == opStop && !sameUser (c->fd))
+       c->reply.status = EPERM;                 // only the server's own user may stop it
+     else if (req->op == opStop) {
+       pthread_mutex_lock (&service.lock);
+       service.stopping = 1;
+       pthread_cond_broadcast (&service.work);
+       pthread_mutex_unlock (&service.lock);
+       shutdown (service.listenFd, SHUT_RDWR);   // wakes the accept loop
+     }
+     else if (req->shared) {
+       if (c->shared == NULL || req->n < 0 || req->n > c->sharedBytes / (long) sizeof(int))
+         c->reply.status = EINVAL;
+       else {
+         c->values = c->shared;
+         serviceSubmit (c);
+       }
+     }
+     else {
+       if (req->n < 0 || req->n > INT_MAX)
+         break;                                  // cannot read what follows
+       c->values = inlineBuffer (c, req->n);
+       if (c->values == NULL)
+         break;
+       if (readFully (c->fd, c->values, req->n * sizeof(int)) != 0)
+         break;
+       serviceSubmit (c);
+     }
+     if (passed >= 0)
+       close (passed);
+     passed = -1;
+
+     if (writeFully (c->fd, &c->reply, sizeof(replyType)) != 0)
+       break;
+     int returnsValues = (req->op == opSort || req->op == opPartition);
+     if (!req->shared && returnsValues && c->reply.status == 0
+         && writeFully (c->fd, c->values, req->n * sizeof(int)) != 0)
+       break;
+   }
+   if (passed >= 0)
+     close (passed);                            // a request abandoned part way
+
+   close (c->fd);
+   if (c->shared != NULL)
+     munmap (c->shared, c->sharedBytes);
+   free (c->spill);
+   returnSlot (c->slot);
+   pthread_mutex_destroy (&c->lock);
+   pthread_cond_destroy (&c->finished);
+   free (c);
+   return NULL;
+ }
+
+ /** *******************************************************************************
+  * run the service until a client sends opStop                                    *
+  * @param  path  the socket to listen on                                          *
+  * @returns  0, or 1 if the socket could not be set up                            *
+  *********************************************************************************/
+ int serviceServer (const char * path) {
+   signal (SIGPIPE, SIG_IGN);
+   int other = serviceConnect (path, 1);
+   if (other >= 0) {
+     close (other);
+     printf ("a server is already listening on %s\n", path);
+     return 1;
+   }
+
+   struct sockaddr_un address = serviceAddress (path);
+   unlink (path);                               // left behind by a server that died
+   service.listenFd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   // the socket is created with mode 0600, so only this user can connect
+   mode_t mask = umask (0177);
+   int bound = (service.listenFd >= 0)
+               ? bind (service.listenFd, (struct sockaddr *) &address, sizeof(address)) : -1;
+   umask (mask);
+   if (bound != 0 || chmod (path, 0600) != 0
+       || listen (service.listenFd, serviceBacklog) != 0) {
+     perror ("sortService");
+     return 1;
+   }
+
+   // warm buffers: allocated and touched once, so no request pays the page faults
+   pthread_mutex_init (&service.lock, NULL);
+   pthread_cond_init (&service.work, NULL);
+   for (int s = 0; s < serviceSlots; s++) {
+     service.slots[s] = (int *) malloc (serviceSmall * sizeof(int));
+     memset (service.slots[s], 0, serviceSmall * sizeof(int));
+     service.slotFree[s] = 1;
+   }
+
+   pthread_t workers [serviceWorkers];
+   for (int w = 0; w < serviceWorkers; w++)
+     pthread_create (&workers[w], NULL, serviceWorker, NULL);
+
+   while (1) {
+     int fd = accept4 (service.listenFd, NULL, NULL, SOCK_CLOEXEC);
+     if (fd < 0 && errno == EINTR)
+       continue;
+     pthread_mutex_lock (&service.lock);
+     int stopping = service.stopping;
+     pthread_mutex_unlock (&service.lock);
+     if (fd < 0 || stopping) {
+       if (fd >= 0)
+         close (fd);
+       break;
+     }
+     connectionType * c = (connectionType *) calloc (1, sizeof(connectionType));
+     c->fd = fd;
+     c->slot = takeSlot ();
+     pthread_mutex_init (&c->lock, NULL);
+     pthread_cond_init (&c->finished, NULL);
+     pthread_t thread;
+     pthread_create (&thread, NULL, serviceConnection, c);
+     pthread_detach (thread);
+   }
+
+   pthread_mutex_lock (&service.lock);
+   service.stopping = 1;
+   pthread_cond_broadcast (&service.work);
+   pthread_mutex_unlock (&service.lock);
+   for (int w = 0; w < serviceWorkers; w++)
+     pthread_join (workers[w], NULL);
+   close (service.listenFd);
+   unlink (path);
+   printf ("server: %ld requests in %ld batches, %.2f requests per batch\n",
+           service.requests, service.batches,
+           (service.batches > 0) ? service.requests / (double) service.batches : 0.0);
+   return 0;
+ }
+
+ /* * * * * * * * * * * * * * * * * client and load generator * * * * * * * * * * * */
+
+ /** *******************************************************************************
+  * send one request and wait for its reply                                        *
+  * @param  fd      the connection                                                 *
+  * @param  req     the request                                                    *
+  * @param  values  the n values of an inline request, replaced by the result of   *
+  *                 a sort or partition                                            *
+  * @param  reply   where to put the reply                                         *
+  * @returns  0, or -1 if the connection failed                                    *
+  *********************************************************************************/
+ int serviceCall (int fd, requestType * req, int values [ ], replyType * reply) {
+   if (writeFully (fd, req, sizeof(requestType)) != 0)
+     return -1;
+   if (!req->shared && req->op <= opPercentile
+       && writeFully (fd, values, req->n * sizeof(int)) != 0)
+     return -1;
+   if (readFully (fd, reply, sizeof(replyType)) != 0)
+     return -1;
+   int returnsValues = (req->op == opSort || req->op == opPartition);
+   if (!req->shared && returnsValues && reply->status == 0
+       && readFully (fd, values, req->n * sizeof(int)) != 0)
+     return -1;
+   return 0;
+ }
+
+ /** *******************************************************************************
+  * check a reply against the values it describes                                  *
+  * @param  req    the request                                                     *
+  * @param  a      the values after the request: rearranged for a sort or          *
+  *                partition, and a permutation of the input for a selection       *
+  * @param  reply  the reply                                                       *
+  * @returns  1 if the reply is right, 0 if not                                    *
+  *********************************************************************************/
+ int checkReply (requestType * req, int a [ ], replyType * reply) {
+   long n = req->n;
+   if (reply->status != 0)
+     return 0;
+   if (req->op == opSort)
+     return checkAscending (a, (int) n)[0] == 'o';
+   if (req->op == opPartition) {
+     long mid = reply->index;
+     if (mid < 0 || mid >= n || a[mid] != reply->value)
+       return 0;
+     for (long i = 0; i < n; i++) {
+       if ((i < mid && a[i] > a[mid]) || (i > mid && a[i] < a[mid]))
+         return 0;
+     }
+     return 1;
+   }
+   long rank = (req->op == opKth) ? req->k : percentileRank (n, req->percent);
+   long less = 0;
+   long notMore = 0;
+   for (long i = 0; i < n; i++) {
+     less += (a[i] < reply->value);
+     notMore += (a[i] <= reply->value);
+   }
+   return reply->index == rank && less <= rank && rank < notMore;
+ }
+
+ /** *******************************************************************************
+  * arguments and results of one load generator thread                             *
+  *********************************************************************************/
+ typedef struct loadArgs {
+   int id;
+   int size;               // values in each request
+   long requests;          // requests to send
+   double * latency;       // seconds from send to reply, for each request
+   long errors;            // replies that failed checkReply, or connection failures
+ } loadType;
+
+ /** *******************************************************************************
+  * load generator thread: one connection sending a mix of sorts, partitions and  *
+  * selections of random values; requests up to serviceSmall values go inline and *
+  * larger ones are written to a memfd the server maps once, so they are not      *
+  * copied through the socket                                                      *
+  *********************************************************************************/
+ void * loadThread (void * arg) {
+   loadType * load = (loadType *) arg;
+   long n = load->size;
+   unsigned seed = 12345 + load->id;
+   int fd = serviceConnect (servicePath, 1);
+   if (fd < 0) {
+     load->errors = load->requests;
+     return NULL;
+   }
+
+   int shared = (n > serviceSmall);
+   int * values;
+   if (shared) {
+     long bytes = n * sizeof(int);
+     // sealed against shrinking once it has its size, as the server requires
+     int memfd = memfd_create ("sortService", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+     replyType reply;
+     requestType attach = { opAttach, 0, bytes, 0, 0 };
+     if (memfd < 0 || ftruncate (memfd, bytes) != 0
+         || fcntl (memfd, F_ADD_SEALS, F_SEAL_SHRINK) != 0)
+       values = (int *) MAP_FAILED;
+     else
+       values = (int *) mmap (NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              memfd, 0);
+     if (values == MAP_FAILED || sendWithDescriptor (fd, &attach, memfd) != 0
+         || readFully (fd, &reply, sizeof(replyType)) != 0 || reply.status != 0) {
+       if (memfd >= 0)
+         close (memfd);
+       close (fd);
+       load->errors = load->requests;
+       return NULL;
+     }
+     close (memfd);
+   }
+   else
+     values = (int *) malloc ((n > 0 ? n : 1) * sizeof(int));
+
+   for (long r = 0; r < load->requests; r++) {
+     for (long i = 0; i < n; i++)
+       values[i] = rand_r (&seed) % (4 * n);
+     requestType req = { (int) (r % 4), shared, n, rand_r (&seed) % n, 0 };
+     req.percent = (r % 8 == 3) ? 50 : 99;
+     replyType reply;
+     double start = wallClock ();
+     if (serviceCall (fd, &req, values, &reply) != 0) {
+       load->errors += load->requests - r;
+       break;
+     }
+     load->latency[r] = wallClock () - start;
+     load->errors += !checkReply (&req, values, &reply);
+   }
+
+   if (shared)
+     munmap (values, n * sizeof(int));
+   else
+     free (values);
+   close (fd);
+   return NULL;
+ }
+
+ /** *******************************************************************************
+  * comparison of doubles for qsort                                                *
+  *********************************************************************************/
+ int compareDoubles (const void * x, const void * y) {
+   double a = * (const double *) x;
+   double b = * (const double *) y;
+   return (a > b) - (a < b);
+ }
+
+ /** *******************************************************************************
+  * run the same mix of requests in this process, allocating and touching a fresh *
+  * buffer for each, as a program that links the sorts itself would               *
+  * @returns  requests per second                                                  *
+  *********************************************************************************/
+ double directRate (int size, long requests) {
+   unsigned seed = 12345;
+   double start = wallClock ();
+   for (long r = 0; r < requests; r++) {
+     int * values = (int *) malloc ((size > 0 ? size : 1) * sizeof(int));
+     for (long i = 0; i < size; i++)
+       values[i] = rand_r (&seed) % (4 * size);
+     requestType req = { (int) (r % 4), 0, size, rand_r (&seed) % size, 0 };
+     req.percent = (r % 8 == 3) ? 50 : 99;
+     replyType reply;
+     serviceExecute (&req, values, &reply);
+     free (values);
+   }
+   return requests / (wallClock () - start);
+ }
+
+ /** *******************************************************************************
+  * run clients load generator threads against the server and print a row of     *
+  * the load table                                                                 *
+  * @param  clients   concurrent connections                                       *
+  * @param  size      values in each request                                       *
+  * @param  requests  requests each client sends                                   *
+  * @param  direct    requests per second in process, from directRate              *
+  * @returns  the number of failed requests                                        *
+  *********************************************************************************/
+ long loadRow (int clients, int size, long requests, double direct) {
+   loadType * loads = (loadType *) calloc (clients, sizeof(loadType));
+   pthread_t * threads = (pthread_t *) malloc (clients * sizeof(pthread_t));
+   double * latency = (double *) calloc (clients * requests, sizeof(double));
+
+   double start = wallClock ();
+   for (int t = 0; t < clients; t++) {
+     loads[t].id = t;
+     loads[t].size = size;
+     loads[t].requests = requests;
+     loads[t].latency = latency + t * requests;
+     pthread_create (&threads[t], NULL, loadThread, &loads[t]);
+   }
+   long errors = 0;
+   for (int t = 0; t < clients; t++) {
+     pthread_join (threads[t], NULL);
+     errors += loads[t].errors;
+   }
+   double elapsed = wallClock () - start;
+
+   long total = clients * requests;
+   qsort (latency, total, sizeof(double), compareDoubles);
+   printf ("%7d %9d %9s %9ld %11.0lf %10.1lf %8.0lf %8.0lf %11.0lf  %2s\n",
+           clients, size, (size > serviceSmall) ? "memfd" : "inline", total,
+           total / elapsed, (double) total * size / elapsed / 1e6,
+           latency[total / 2] * 1e6, latency[total - 1 - total / 100] * 1e6,
+           direct, (errors == 0) ? "ok" : "NO");
+
+   free (latency);
+   free (threads);
+   free (loads);
+   return errors;
+ }
+
+ /** *******************************************************************************
+  * requests each client sends for a row of the load table                        *
+  *********************************************************************************/
+ long loadRequests (int clients, int size) {
+   long requests = loadValues / size;
+   requests = (requests < loadRequestsMax) ? requests : loadRequestsMax;
+   requests /= clients;
+   return (requests > loadRequestsMin) ? requests : loadRequestsMin;
+ }
+
+ /** *******************************************************************************
+  * ask the server to stop                                                         *
+  * @returns  0, or 1 if no server answered or it refused                         *
+  *********************************************************************************/
+ int stopServer ( ) {
+   int fd = serviceConnect (servicePath, 1);
+   requestType req = { opStop, 0, 0, 0, 0 };
+   replyType reply;
+   if (fd < 0 || writeFully (fd, &req, sizeof(requestType)) != 0
+       || readFully (fd, &reply, sizeof(replyType)) != 0) {
+     printf ("no server answered on %s\n", servicePath);
+     return 1;
+   }
+   close (fd);
+   if (reply.status != 0) {
+     printf ("server on %s refused to stop: %s\n", servicePath, strerror (reply.status));
+     return 1;
+   }
+   return 0;
+ }
+
+ /** *******************************************************************************
+  * driver program: start a server, time the load table against it, stop it       *
+  *********************************************************************************/
+ int main (int argc, char * argv [ ]) {
+   signal (SIGPIPE, SIG_IGN);
+   if (argc > 1 && strcmp (argv[1], "server") == 0)
+     return serviceServer (servicePath);
+   if (argc > 1 && strcmp (argv[1], "stop") == 0)
+     return stopServer ();
+   if (argc > 3 && strcmp (argv[1], "client") == 0) {
+     int clients = atoi (argv[2]);
+     int size = atoi (argv[3]);
+     if (clients < 1 || size < 1) {
+       printf ("usage: sortService client clients size\n");
+       return 1;
+     }
+     printf ("Clients      Size Transport  Requests  Requests/s  Mvalues/s   p50 us   p99 us   Direct/s\n");
+     long requests = loadRequests (clients, size);
+     return loadRow (clients, size, requests, directRate (size, requests)) != 0;
+   }
+
+   fflush (stdout);
+   pid_t server = fork ();
+   if (server == 0)
+     exit (serviceServer (servicePath));
+   int ready = serviceConnect (servicePath, 500);
+   if (ready < 0) {
+     printf ("server did not start\n");
+     return 1;
+   }
+   close (ready);
+
+   // print headings
+   printf ("Sort service on %s, %d workers, batches of up to %d small requests\n",
+           servicePath, serviceWorkers, serviceBatch);
+   printf ("requests rotate sort, partition, kth element, percentile;"
+           " Direct/s runs them in one process with a fresh buffer each\n");
+   printf ("Clients      Size Transport  Requests  Requests/s  Mvalues/s   p50 us   p99 us   Direct/s\n");
+
+   int sizes [ ] = { 100, 1000, 4096, 100000, 1000000 };
+   int clientCounts [ ] = { 1, 4, 16 };
+   for (int s = 0; s < 5; s++) {
+     double direct = directRate (sizes[s], loadRequests (1, sizes[s]));
+     for (int c = 0; c < 3; c++)
+       loadRow (clientCounts[c], sizes[s], loadRequests (clientCounts[c], sizes[s]), direct);
+     printf ("\n");
+   }
+
+   fflush (stdout);
+   stopServer ();
+   waitpid (server, NULL, 0);
+   return 0;
+ }
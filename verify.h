@@ -0,0 +1,291 @@
+/* verification of sorting and partitioning results, shared by the timing programs
+ *
+ *    order checks compare four neighbours at a time with SSE2 and split large
+ *    arrays among verifyThreads threads; the multiset fingerprint is order
+ *    independent, so comparing the fingerprints taken before and after a run
+ *    catches a sort or partition that dropped or duplicated values; every
+ *    function is static inline, so more than one file of a program may
+ *    include it, and a file that uses only some of them gets no warnings
+ */
+
+ #ifndef verifyIncluded
+ #define verifyIncluded
+
+ #include <emmintrin.h>  // for SSE2 compares
+ #include <pthread.h>    // for the verification threads
+
+ #define verifyThreads 4             // threads the checks use on large arrays
+ #define verifyMinParallel (1 << 18) // smaller arrays are checked by one thread
+ #define fingerprintPrime ((1UL << 61) - 1)          // modulus of the polynomial
+ #define fingerprintPoint 0x0d1f0a3c5e6b7981UL       // where the polynomial is
+                                                     // evaluated, below the modulus
+
+ /** *******************************************************************************
+  * order-independent fingerprint of a multiset of values                         *
+  *********************************************************************************/
+ typedef struct fingerprint {
+   unsigned long sum;    // sum of the values, mod 2^64
+   unsigned long mixed;  // exclusive or of the values after mixing
+   unsigned long poly;   // product of (fingerprintPoint - value), mod 2^61 - 1
+ } fingerprintType;
+
+ /** *******************************************************************************
+  * one thread's share of a check: its range and its answer                        *
+  *********************************************************************************/
+ typedef struct verifyArgs {
+   int * a;
+   long lo;                 // first index of the share
+   long hi;                 // one past the last index; order checks read a[hi]
+                            // too, when it is inside the array
+   long n;                  // size of the whole array
+   long mid;                // pivot index, for partition checks
+   int pivot;
+   long result;             // first failing index or -1; code for partition checks
+   fingerprintType print;
+ } verifyType;
+
+ /** *******************************************************************************
+  * run a check on up to threads threads, each on an equal share of n elements    *
+  * @param  worker   the check, run once per share                                 *
+  * @param  shared   a[], n, mid and pivot for every share                         *
+  * @param  args     room for one verifyType per thread                            *
+  * @param  threads  the most threads to use                                       *
+  * @returns  the number of shares, whose results are in args                      *
+  *********************************************************************************/
+ static inline int verifySplit (void * (*worker) (void *), verifyType * shared, verifyType args [ ], int threads) {
+   long n = shared->n;
+   int shares = (n < verifyMinParallel || threads < 1) ? 1 : threads;
+   pthread_t ids [shares];
+   for (int t = 0; t < shares; t++) {
+     args[t] = *shared;
+     args[t].lo = n * t / shares;
+     args[t].hi = n * (t + 1) / shares;
+     if (t > 0)
+       pthread_create (&ids[t], NULL, worker, &args[t]);
+   }
+   worker (&args[0]);
+   for (int t = 1; t < shares; t++)
+     pthread_join (ids[t], NULL);
+   return shares;
+ }
+
+ /** *******************************************************************************
+  * worker: first i in lo, ..., hi-1 with a[i] > a[i+1], or -1                     *
+  *********************************************************************************/
+ static inline void * ascendingWorker (void * arg) {
+   verifyType * v = (verifyType *) arg;
+   int * a = v->a;
+   long last = (v->hi < v->n) ? v->hi : v->n - 1;   // pairs (i, i+1) with i < last
+   long i = v->lo;
+   v->result = -1;
+   __m128i bad = _mm_setzero_si128 ();
+   for (; i + 4 <= last; i += 4) {
+     __m128i x = _mm_loadu_si128 ((__m128i *) &a[i]);
+     __m128i y = _mm_loadu_si128 ((__m128i *) &a[i+1]);
+     bad = _mm_or_si128 (bad, _mm_cmpgt_epi32 (x, y));
+     if (((i - v->lo) & 4095) == 0 && _mm_movemask_epi8 (bad))
+       break;
+   }
+   if (_mm_movemask_epi8 (bad))
+     i = v->lo;                          // find the exact index the slow way
+   for (; i < last; i++) {
+     if (a[i] > a[i+1]) {
+       v->result = i;
+       break;
+     }
+   }
+   return NULL;
+ }
+
+ /** *******************************************************************************
+  * check array elements are in non-descending order                              *
+  * @param  a        the array                                                     *
+  * @param  n        the size of the array                                         *
+  * @param  threads  the most threads to use                                       *
+  * @returns  the first i with a[i] > a[i+1], or -1 if there is none               *
+  *********************************************************************************/
+ static inline long verifyAscending (int a [ ], long n, int threads) {
+   verifyType shared = { a, 0, 0, n, 0, 0, -1, {0, 0, 0} };
+   verifyType args [threads > 0 ? threads : 1];
+   int shares = verifySplit (ascendingWorker, &shared, args, threads);
+   for (int t = 0; t < shares; t++) {
+     if (args[t].result >= 0)
+       return args[t].result;
+   }
+   return -1;
+ }
+
+ /** *******************************************************************************
+  * the plain loop verifyAscending replaces, kept to measure it against            *
+  * @returns  the first i with a[i] > a[i+1], or -1 if there is none               *
+  *********************************************************************************/
+ static inline long verifyAscendingScalar (int a [ ], long n) {
+   for (long i = 0; i < n-1; i++) {
+     if (a[i] > a[i+1])
+       return i;
+   }
+   return -1;
+ }
+
+ /** *******************************************************************************
+  * worker: first i in lo, ..., hi-1 with a[i] != 2i, or -1                        *
+  *********************************************************************************/
+ static inline void * ascValuesWorker (void * arg) {
+   verifyType * v = (verifyType *) arg;
+   int * a = v->a;
+   long i = v->lo;
+   v->result = -1;
+   __m128i expect = _mm_setr_epi32 (2*i, 2*i + 2, 2*i + 4, 2*i + 6);
+   __m128i step = _mm_set1_epi32 (8);
+   __m128i same = _mm_set1_epi32 (-1);
+   for (; i + 4 <= v->hi; i += 4) {
+     same = _mm_and_si128 (same, _mm_cmpeq_epi32 (_mm_loadu_si128 ((__m128i *) &a[i]), expect));
+     expect = _mm_add_epi32 (expect, step);
+   }
+   if (_mm_movemask_epi8 (same) != 0xFFFF)
+     i = v->lo;
+   for (; i < v->hi; i++) {
+     if (a[i] != 2*i) {
+       v->result = i;
+       break;
+     }
+   }
+   return NULL;
+ }
+
+ /** *******************************************************************************
+  * check array elements have values 0, 2, 4, . . ., 2(n-1)                        *
+  * @returns  the first i with a[i] != 2i, or -1 if there is none                  *
+  *********************************************************************************/
+ static inline long verifyAscValues (int a [ ], long n, int threads) {
+   verifyType shared = { a, 0, 0, n, 0, 0, -1, {0, 0, 0} };
+   verifyType args [threads > 0 ? threads : 1];
+   int shares = verifySplit (ascValuesWorker, &shared, args, threads);
+   for (int t = 0; t < shares; t++) {
+     if (args[t].result >= 0)
+       return args[t].result;
+   }
+   return -1;
+ }
+
+ /** *******************************************************************************
+  * worker: 2 if an element of lo, ..., hi-1 before mid exceeds the pivot,         *
+  * 3 if one after mid is below it, 0 otherwise; indices are relative to a         *
+  *********************************************************************************/
+ static inline void * partitionWorker (void * arg) {
+   verifyType * v = (verifyType *) arg;
+   int * a = v->a;
+   __m128i pivot = _mm_set1_epi32 (v->pivot);
+   __m128i bad = _mm_setzero_si128 ();
+   long split = (v->mid < v->lo) ? v->lo : (v->mid > v->hi) ? v->hi : v->mid;
+   long i;
+   v->result = 0;
+
+   // before mid: a[i] > pivot is wrong
+   for (i = v->lo; i + 4 <= split; i += 4)
+     bad = _mm_or_si128 (bad, _mm_cmpgt_epi32 (_mm_loadu_si128 ((__m128i *) &a[i]), pivot));
+   for (; i < split; i++)
+     bad = _mm_or_si128 (bad, _mm_set1_epi32 (-(a[i] > v->pivot)));
+   if (_mm_movemask_epi8 (bad)) {
+     v->result = 2;
+     return NULL;
+   }
+
+   // after mid: a[i] < pivot is wrong
+   i = (split == v->mid) ? split + 1 : split;
+   for (; i + 4 <= v->hi; i += 4)
+     bad = _mm_or_si128 (bad, _mm_cmpgt_epi32 (pivot, _mm_loadu_si128 ((__m128i *) &a[i])));
+   for (; i < v->hi; i++)
+     bad = _mm_or_si128 (bad, _mm_set1_epi32 (-(a[i] < v->pivot)));
+   if (_mm_movemask_epi8 (bad))
+     v->result = 3;
+   return NULL;
+ }
+
+ /** *******************************************************************************
+  * check a segment is partitioned around a[mid]                                   *
+  * @param  a        the array                                                     *
+  * @param  first    the index at the start of the segment                         *
+  * @param  last     the index at the end of the segment                           *
+  * @param  mid      the pivot's index, first <= mid <= last                       *
+  * @param  threads  the most threads to use                                       *
+  * @returns  2 if some a[first], ..., a[mid-1] is greater than a[mid],            *
+  *           3 if some a[mid+1], ..., a[last] is less than a[mid], 0 otherwise    *
+  *********************************************************************************/
+ static inline int verifyPartition (int a [ ], long first, long last, long mid, int threads) {
+   verifyType shared = { a + first, 0, 0, last - first + 1, mid - first, a[mid], 0, {0, 0, 0} };
+   verifyType args [threads > 0 ? threads : 1];
+   int shares = verifySplit (partitionWorker, &shared, args, threads);
+   int result = 0;
+   for (int t = 0; t < shares; t++) {
+     if (result == 0 || (args[t].result != 0 && args[t].result < result))
+       result = args[t].result;
+   }
+   return result;
+ }
+
+ /** *******************************************************************************
+  * multiply mod 2^61 - 1                                                          *
+  *********************************************************************************/
+ static inline unsigned long fingerprintMultiply (unsigned long x, unsigned long y) {
+   unsigned __int128 p = (unsigned __int128) x * y;
+   unsigned long r = (unsigned long) (p & fingerprintPrime) + (unsigned long) (p >> 61);
+   return (r >= fingerprintPrime) ? r - fingerprintPrime : r;
+ }
+
+ /** *******************************************************************************
+  * worker: fingerprint of a[lo], ..., a[hi-1]; four products run side by side so  *
+  * the multiplications overlap                                                    *
+  *********************************************************************************/
+ static inline void * fingerprintWorker (void * arg) {
+   verifyType * v = (verifyType *) arg;
+   int * a = v->a;
+   unsigned long sum = 0;
+   unsigned long mixed = 0;
+   unsigned long poly [4] = {1, 1, 1, 1};
+   // values shifted by 2^31 are all below fingerprintPoint, so the factors are positive
+   long i;
+   for (i = v->lo; i < v->hi; i++) {
+     unsigned long x = (unsigned long) ((long) a[i] + 2147483648L);
+     sum += x;
+     unsigned long m = x * 0x9e3779b97f4a7c15UL;
+     mixed ^= m ^ (m >> 29);
+     poly[i & 3] = fingerprintMultiply (poly[i & 3], fingerprintPoint - x);
+   }
+   v->print.sum = sum;
+   v->print.mixed = mixed;
+   v->print.poly = fingerprintMultiply (fingerprintMultiply (poly[0], poly[1]),
+                                        fingerprintMultiply (poly[2], poly[3]));
+   return NULL;
+ }
+
+ /** *******************************************************************************
+  * fingerprint of the multiset of values in an array                              *
+  * @param  a        the array                                                     *
+  * @param  n        the size of the array                                         *
+  * @param  threads  the most threads to use                                       *
+  * @returns  a fingerprint that does not depend on the order of the values; two   *
+  *           arrays holding different multisets give different fingerprints      *
+  *           except with probability about n / 2^61                              *
+  *********************************************************************************/
+ static inline fingerprintType fingerprintArray (int a [ ], long n, int threads) {
+   verifyType shared = { a, 0, 0, n, 0, 0, 0, {0, 0, 0} };
+   verifyType args [threads > 0 ? threads : 1];
+   int shares = verifySplit (fingerprintWorker, &shared, args, threads);
+   fingerprintType print = {0, 0, 1};
+   for (int t = 0; t < shares; t++) {
+     print.sum += args[t].print.sum;
+     print.mixed ^= args[t].print.mixed;
+     print.poly = fingerprintMultiply (print.poly, args[t].print.poly);
+   }
+   return print;
+ }
+
+ /** *******************************************************************************
+  * @returns  1 if two fingerprints are the same, 0 if not                         *
+  *********************************************************************************/
+ static inline int fingerprintEqual (fingerprintType x, fingerprintType y) {
+   return x.sum == y.sum && x.mixed == y.mixed && x.poly == y.poly;
+ }
+
+ #endif